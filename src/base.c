@@ -23,16 +23,17 @@ extern long Z502_REG3;
 extern PCB *RootPCB;
 extern PCB *CurrentPCB;
 extern ConfigArgEntry *ConfigArgument;
-extern char MEMORY[PHYS_MEM_PGS * PGSIZE ];
+extern char *MEMORY;
 
 char *call_names[] = {"mem_read ", "mem_write", "read_mod ", "get_time ", "sleep    ", "get_pid  ",
     "create   ", "term_proc", "suspend  ", "resume   ", "ch_prior ",
-    "send     ", "receive  ", "disk_read", "disk_wrt ", "def_sh_ar"};
+    "send     ", "receive  ", "disk_read", "disk_wrt ", "def_sh_ar", "fork     ",
+    "mem_advic", "map_disk ", "sync_disk", "reg_uflt ", "recv_flt ", "inst_page", "pg_stats ",
+    "set_param"};
 
-extern UINT16 *shadow_pg_tbl[PHYS_MEM_PGS];
-extern UINT16 process_holder[PHYS_MEM_PGS];
-extern UINT16 *address_holder[10];
-extern int shadow_pg_idx;
+extern UINT32 *shadow_pg_tbl[MAX_ALL_MEM_PGS];
+extern UINT16 process_holder[MAX_ALL_MEM_PGS];
+extern INT32 vpn_holder[MAX_ALL_MEM_PGS];
 extern int ref_idx;
 
 /************************************************************************
@@ -76,7 +77,8 @@ void interrupt_handler(void)
     {
         os_make_ready_to_run();
     }
-    else if (device_id >= 5 || device_id <= 7)
+    else if (device_id >= DISK_INTERRUPT
+            && device_id < DISK_INTERRUPT + MAX_NUMBER_OF_DISKS)
     {
         read_write_scheduler(device_id);
     }
@@ -120,7 +122,7 @@ void fault_handler(void)
         }
     }
 
-    if (status >= 1024)
+    if (status < 0 || status >= CurrentPCB->virtual_pages)
     {
         printf("Invalid address: virtual page number out of range!\n");
         shut_down();
@@ -137,8 +139,8 @@ void fault_handler(void)
             if (shadow_pg_tbl[idx] != NULL)
             {
                 MP_setup((INT32) ((*shadow_pg_tbl[idx]) & PTBL_FRAME_BITS), (INT32) process_holder[idx],
-                         (INT32) (shadow_pg_tbl[idx] - address_holder[process_holder[idx]]),
-                         (INT32) ((*shadow_pg_tbl[idx]) & PTBL_STATE_BITS) >> 13);
+                         vpn_holder[idx],
+                         (INT32) (((*shadow_pg_tbl[idx]) & PTBL_STATE_BITS) >> PTBL_STATE_SHIFT));
             }
         }
         MP_print_line();
@@ -154,8 +156,8 @@ void fault_handler(void)
                 if (shadow_pg_tbl[idx] != NULL)
                 {
                     MP_setup((INT32) ((*shadow_pg_tbl[idx]) & PTBL_FRAME_BITS), (INT32) process_holder[idx],
-                             (INT32) (shadow_pg_tbl[idx] - address_holder[process_holder[idx]]),
-                             (INT32) ((*shadow_pg_tbl[idx]) & PTBL_STATE_BITS) >> 13);
+                             vpn_holder[idx],
+                             (INT32) (((*shadow_pg_tbl[idx]) & PTBL_STATE_BITS) >> PTBL_STATE_SHIFT));
                 }
             }
             MP_print_line();
@@ -163,6 +165,7 @@ void fault_handler(void)
     }
     // Clear out this device - we're done with it
     write_to_memory(Z502InterruptClear, &Index);
+    reap_zombies();
 } /* End of fault_handler */
 
 /************************************************************************
@@ -266,7 +269,7 @@ void svc(SYSTEM_CALL_DATA * SystemCallData)
         case SYSNUM_CHANGE_PRIORITY:
         {
             os_change_priority((INT32) SystemCallData->Argument[0],
-                               (INT32) SystemCallData->Argument[1],
+                               (INT32) (long) SystemCallData->Argument[1],
                                SystemCallData->Argument[2]);
             break;
         }
@@ -285,17 +288,108 @@ void svc(SYSTEM_CALL_DATA * SystemCallData)
         }
         case SYSNUM_DISK_READ:
         {
-            os_disk_read((INT32) SystemCallData->Argument[0],
-                         (INT32) SystemCallData->Argument[1],
-                         (char *) SystemCallData->Argument[2]);
+            os_user_disk_read((INT32) (long) SystemCallData->Argument[0],
+                              (INT32) (long) SystemCallData->Argument[1],
+                              (char *) SystemCallData->Argument[2],
+                              SystemCallData->Argument[3]);
 
             break;
         }
         case SYSNUM_DISK_WRITE:
         {
-            os_disk_write((INT32) SystemCallData->Argument[0],
-                          (INT32) SystemCallData->Argument[1],
-                          (char *) SystemCallData->Argument[2]);
+            os_user_disk_write((INT32) (long) SystemCallData->Argument[0],
+                               (INT32) (long) SystemCallData->Argument[1],
+                               (char *) SystemCallData->Argument[2],
+                               SystemCallData->Argument[3]);
+            break;
+        }
+        case SYSNUM_DEFINE_SHARED_AREA:
+        {
+            os_define_shared_area((long) SystemCallData->Argument[0],
+                                  (INT32) (long) SystemCallData->Argument[1],
+                                  (const char *) SystemCallData->Argument[2],
+                                  SystemCallData->Argument[3],
+                                  SystemCallData->Argument[4]);
+            break;
+        }
+        case SYSNUM_FORK_PROCESS:
+        {
+            pcb = os_fork_process((const char *) SystemCallData->Argument[0],
+                                  (void *) SystemCallData->Argument[1],
+                                  (INT32) (long) SystemCallData->Argument[2],
+                                  SystemCallData->Argument[4]);
+            if (pcb)
+            {
+                *SystemCallData->Argument[3] = (long) pcb->pid;
+                print_scheduling_info(ACTION_NAME_CREATE, pcb, NORMAL_INFO);
+            }
+            else
+            {
+                *SystemCallData->Argument[3] = -1;
+            }
+            break;
+        }
+        case SYSNUM_MEMORY_ADVICE:
+        {
+            os_memory_advice((long) SystemCallData->Argument[0],
+                             (INT32) (long) SystemCallData->Argument[1],
+                             (INT32) (long) SystemCallData->Argument[2],
+                             SystemCallData->Argument[3]);
+            break;
+        }
+        case SYSNUM_MAP_DISK:
+        {
+            os_map_disk((long) SystemCallData->Argument[0],
+                        (INT32) (long) SystemCallData->Argument[1],
+                        (INT32) (long) SystemCallData->Argument[2],
+                        (INT32) (long) SystemCallData->Argument[3],
+                        SystemCallData->Argument[4]);
+            break;
+        }
+        case SYSNUM_SYNC_DISK:
+        {
+            os_sync_disk((long) SystemCallData->Argument[0],
+                         (INT32) (long) SystemCallData->Argument[1],
+                         SystemCallData->Argument[2]);
+            break;
+        }
+        case SYSNUM_REGISTER_USERFAULT:
+        {
+            os_register_userfault((long) SystemCallData->Argument[0],
+                                  (INT32) (long) SystemCallData->Argument[1],
+                                  (INT32) (long) SystemCallData->Argument[2],
+                                  SystemCallData->Argument[3]);
+            break;
+        }
+        case SYSNUM_RECEIVE_FAULT:
+        {
+            os_receive_fault(SystemCallData->Argument[0],
+                             SystemCallData->Argument[1],
+                             SystemCallData->Argument[2]);
+            break;
+        }
+        case SYSNUM_INSTALL_PAGE:
+        {
+            os_install_page((INT32) (long) SystemCallData->Argument[0],
+                            (long) SystemCallData->Argument[1],
+                            (INT32) (long) SystemCallData->Argument[2],
+                            (long) SystemCallData->Argument[3],
+                            SystemCallData->Argument[4]);
+            break;
+        }
+        case SYSNUM_GET_PAGING_STATS:
+        {
+            os_get_paging_stats((INT32) (long) SystemCallData->Argument[0],
+                                (PAGING_STATS *) SystemCallData->Argument[1],
+                                SystemCallData->Argument[2]);
+            break;
+        }
+        case SYSNUM_SET_PAGING_PARAMETER:
+        {
+            os_set_paging_parameter((INT32) (long) SystemCallData->Argument[0],
+                                    (INT32) (long) SystemCallData->Argument[1],
+                                    (INT32) (long) SystemCallData->Argument[2],
+                                    SystemCallData->Argument[3]);
             break;
         }
         default:
@@ -305,6 +399,7 @@ void svc(SYSTEM_CALL_DATA * SystemCallData)
             break;
         }
     } // End of switch
+    reap_zombies();
 } // End of svc
 
 /************************************************************************
@@ -41,13 +41,43 @@ typedef int BOOL;
 #define         FALSE                           (BOOL)0
 #define         TRUE                            (BOOL)1
 
-#define         PHYS_MEM_PGS                    (short)64
+//  The sizes of physical memory and of the default virtual address space
+//  are chosen when the simulator starts, from the environment variables
+//  Z502_PHYS_MEM_PGS, Z502_SLOW_MEM_PGS and Z502_VIRTUAL_MEM_PGS, see
+//  Z502Init(). Frames are named by the frame field of a page table entry,
+//  so both tiers together hold at most MAX_ALL_MEM_PGS frames, 16384 frames
+//  or 256 KB.
+#define         DEFAULT_PHYS_MEM_PGS            64
+#define         DEFAULT_SLOW_MEM_PGS            0
+#define         DEFAULT_VIRTUAL_MEM_PGS         1024
+#define         MAX_ALL_MEM_PGS                 (PTBL_PHYS_PG_NO + 1)
+#define         PHYS_MEM_PGS                    Z502PhysMemPgs
+//  The page size is not chosen at start: a page is also the disk sector
+//  size, the unit of a swap slot and of a mapped sector, and the tests'
+//  addresses are built from it.
 #define         PGSIZE                          (short)16
 #define         PGBITS                          (short)4
-#define         VIRTUAL_MEM_PGS                 1024
+#define         VIRTUAL_MEM_PGS                 Z502VirtualMemPgs
 #define         VMEMPGBITS                      10
+
+//  With a page directory installed, the upper bits of a virtual page number
+//  index the directory and the lower PTBL_LEAF_BITS index a second level table.
+#define         PTBL_LEAF_BITS                  6
+#define         PTBL_LEAF_ENTRIES               (1 << PTBL_LEAF_BITS)
+#define         PTBL_DIR_ENTRIES                1024
+#define         VIRTUAL_MEM_PGS_MAX             (PTBL_DIR_ENTRIES * PTBL_LEAF_ENTRIES)
 #define         MEMSIZE                         PHYS_MEM_PGS * PGSIZE
 
+//  A second, larger and slower tier of physical memory follows the first
+//  one: frames PHYS_MEM_PGS and up cost COST_OF_SLOW_MEMORY_ACCESS to reach.
+//  The slow tier is left out unless Z502_SLOW_MEM_PGS asks for one.
+#define         SLOW_MEM_PGS                    Z502SlowMemPgs
+#define         ALL_MEM_PGS                     (short)(PHYS_MEM_PGS + SLOW_MEM_PGS)
+
+extern INT16 Z502PhysMemPgs;
+extern INT16 Z502SlowMemPgs;
+extern INT32 Z502VirtualMemPgs;
+
 /*****************************************************************
         The next two variables have special meaning.  They allow the
         Z502 processor to report information about its state.  From
@@ -61,11 +91,21 @@ typedef int BOOL;
 
 
 /* Meaning of locations in a page table entry          */
-
-#define         PTBL_VALID_BIT                  0x8000
-#define         PTBL_MODIFIED_BIT               0x4000
-#define         PTBL_REFERENCED_BIT             0x2000
-#define         PTBL_PHYS_PG_NO                 0x0FFF
+//  An entry is 32 bits wide.  The state bits take the upper half, so none
+//  of them narrows the frame field.  The field has 14 bits, so a frame
+//  number, and the frames of both tiers together, fit in an INT16.
+
+#define         PTBL_VALID_BIT                  0x80000000
+#define         PTBL_MODIFIED_BIT               0x40000000
+#define         PTBL_REFERENCED_BIT             0x20000000
+//  A write to a valid page with the protected bit set faults, a read does not.
+#define         PTBL_PROTECTED_BIT              0x08000000
+//  Set on the entries of an aligned block of LARGE_PAGE_PGS virtual pages
+//  held by the aligned run of frames of the same size, so a single TLB entry
+//  covers the block.  Each entry still names its own frame.
+#define         PTBL_LARGE_PAGE_BIT             0x04000000
+#define         PTBL_PHYS_PG_NO                 0x00003FFF
+#define         LARGE_PAGE_PGS                  16
 
 /*  The maximum number of disks we will support:        */
 
@@ -74,6 +114,10 @@ typedef int BOOL;
 
 /*      These are the memory mapped IO addresses                */
 
+#define      Z502TLBMisses             Z502TLBHits+1
+#define      Z502TLBHits               Z502TLBInvalidate+1
+#define      Z502TLBInvalidate         Z502InvalidateTranslation+1
+#define      Z502InvalidateTranslation Z502InterruptDevice+1
 #define      Z502InterruptDevice       Z502InterruptStatus+1
 #define      Z502InterruptStatus       Z502InterruptClear+1
 #define      Z502InterruptClear        Z502ClockStatus+1
@@ -145,6 +189,10 @@ typedef int BOOL;
 /* Miscellaneous                                        */
 
 #define         NUM_LOGICAL_SECTORS                     (short)1600
+/* Every disk has NUM_SWAP_SECTORS more sectors after its logical ones, which
+   only the OS reaches: DISK_READ and DISK_WRITE refuse them.                */
+#define         NUM_SWAP_SECTORS                        (short)800
+#define         NUM_DISK_SECTORS                        (short)(NUM_LOGICAL_SECTORS + NUM_SWAP_SECTORS)
 
 #define         SWITCH_CONTEXT_KILL_MODE                (short)0
 #define         SWITCH_CONTEXT_SAVE_MODE                (short)1
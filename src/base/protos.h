@@ -45,6 +45,19 @@ void test2c(void);
 void test2d(void);
 void test2e(void);
 void test2f(void);
+void test2g(void);
+void test2h(void);
+void test2i(void);
+void test2j(void);
+void test2k(void);
+void test2l(void);
+void test2m(void);
+void test2n(void);
+void test2o(void);
+void test2p(void);
+void test2q(void);
+void test2r(void);
+void test2s(void);
 
 //                      ENTRIES in z502.c
 
@@ -304,9 +304,12 @@ H  VMR    7775555447777
 
 /****************************************************************************
     Here's the structure we're going to fill in containing all the info to
-        be printed.
+        be printed.  A line holds one column per frame, so only the first
+        MP_PRINTED_FRAMES frames are shown.
  ****************************************************************************/
 
+#define         MP_PRINTED_FRAMES               64
+
 typedef struct
 {
     INT32 contains_data;
@@ -317,7 +320,7 @@ typedef struct
 
 typedef struct
 {
-    MP_FRAME_ENTRY entry[PHYS_MEM_PGS];
+    MP_FRAME_ENTRY entry[MP_PRINTED_FRAMES];
 } MP_FRAME_TABLE;
 
 MP_FRAME_TABLE MP_ft;
@@ -349,15 +352,17 @@ void MP_setup(INT32 frame, INT32 pid, INT32 logical_page, INT32 state)
                frame, PHYS_MEM_PGS - 1);
         return;
     }
+    if (frame >= MP_PRINTED_FRAMES)
+        return;
     if (pid < 0 || pid > 9)
     {
         printf("Input PID %d not in range 0 - 9 in MP_setup.\n", pid);
         return;
     }
-    if (logical_page < 0 || logical_page >= VIRTUAL_MEM_PGS)
+    if (logical_page < 0 || logical_page >= VIRTUAL_MEM_PGS_MAX)
     {
         printf("Input logical page (%d) not in range 0 - %d in MP_setup.\n",
-               logical_page, VIRTUAL_MEM_PGS - 1);
+               logical_page, VIRTUAL_MEM_PGS_MAX - 1);
         return;
     }
     if (state < 0 || state > 7)
@@ -383,12 +388,12 @@ void MP_print_line(void)
 {
     INT32 index;
     INT32 temp;
-    char output_line3[PHYS_MEM_PGS + 5];
-    char output_line4[PHYS_MEM_PGS + 5];
-    char output_line5[PHYS_MEM_PGS + 5];
-    char output_line6[PHYS_MEM_PGS + 5];
-    char output_line7[PHYS_MEM_PGS + 5];
-    char output_line8[PHYS_MEM_PGS + 5];
+    char output_line3[MP_PRINTED_FRAMES + 5];
+    char output_line4[MP_PRINTED_FRAMES + 5];
+    char output_line5[MP_PRINTED_FRAMES + 5];
+    char output_line6[MP_PRINTED_FRAMES + 5];
+    char output_line7[MP_PRINTED_FRAMES + 5];
+    char output_line8[MP_PRINTED_FRAMES + 5];
 
     /*  Header Line */
     SP_do_output("\n                       PHYSICAL MEMORY STATE\n");
@@ -404,7 +409,7 @@ void MP_print_line(void)
     strcpy(output_line7, "                                                                 \n");
     strcpy(output_line8, "                                                                 \n");
 
-    for (index = 0; index < PHYS_MEM_PGS; index++)
+    for (index = 0; index < PHYS_MEM_PGS && index < MP_PRINTED_FRAMES; index++)
     {
         if (MP_ft.entry[index].contains_data == TRUE)
         {
@@ -443,6 +448,6 @@ void MP_print_line(void)
 void MP_initialize(void)
 {
     short index;
-    for (index = 0; index < PHYS_MEM_PGS; index++)
+    for (index = 0; index < PHYS_MEM_PGS && index < MP_PRINTED_FRAMES; index++)
         MP_ft.entry[index].contains_data = FALSE;
 }
\ No newline at end of file
@@ -25,6 +25,65 @@
 #define         SYSNUM_CHANGE_PRIORITY                 10
 #define         SYSNUM_DISK_READ                       13
 #define         SYSNUM_DISK_WRITE                      14
+#define         SYSNUM_DEFINE_SHARED_AREA              15
+#define         SYSNUM_FORK_PROCESS                    16
+#define         SYSNUM_MEMORY_ADVICE                   17
+#define         SYSNUM_MAP_DISK                        18
+#define         SYSNUM_SYNC_DISK                       19
+#define         SYSNUM_REGISTER_USERFAULT              20
+#define         SYSNUM_RECEIVE_FAULT                   21
+#define         SYSNUM_INSTALL_PAGE                    22
+#define         SYSNUM_GET_PAGING_STATS                23
+#define         SYSNUM_SET_PAGING_PARAMETER            24
+
+/* Access hints given by MEMORY_ADVICE for a range of pages  */
+
+#define         ADVICE_NORMAL                          0L
+#define         ADVICE_SEQUENTIAL                      1L
+#define         ADVICE_RANDOM                          2L
+#define         ADVICE_WILLNEED                        3L
+#define         ADVICE_DONTNEED                        4L
+
+/* How INSTALL_PAGE fills the page of a faulting process     */
+
+#define         USERFAULT_COPY                         0L
+#define         USERFAULT_MAP                          1L
+
+/* Which statistics GET_PAGING_STATS returns, besides a pid  */
+
+#define         PAGING_STATS_SELF                      -1L
+#define         PAGING_STATS_SYSTEM                    -2L
+
+/* What SET_PAGING_PARAMETER sets for a process              */
+
+#define         PAGING_PARAMETER_FRAME_QUOTA           0L
+#define         PAGING_PARAMETER_FAULT_AROUND          1L
+
+// The paging statistics returned by GET_PAGING_STATS. A major fault had to
+// read its page from a disk, a minor one did not. An eviction is dirty if
+// the page had to be written out on its way out of memory. Page-ins and
+// page-outs count the pages read from and written to a disk. Bucket i of
+// the fault latency counts the faults served in less than
+// FAULT_LATENCY_BASE << i units of simulated time, the last bucket all
+// slower ones. The free frame low-water mark is the fewest free frames
+// there have been, for the whole system. A frame wait is a fault which
+// found every frame in flight and waited for one.
+
+#define         FAULT_LATENCY_BUCKETS                  10
+#define         FAULT_LATENCY_BASE                     8
+
+typedef struct
+{
+    INT32 major_faults;
+    INT32 minor_faults;
+    INT32 clean_evictions;
+    INT32 dirty_evictions;
+    INT32 page_ins;
+    INT32 page_outs;
+    INT32 fault_latency[FAULT_LATENCY_BUCKETS];
+    INT32 free_frames_low_water;
+    INT32 frame_waits;
+} PAGING_STATS;
 
 // This structure defines the format used for all system calls.
 // For each call, the structure is filled in and then its address
@@ -197,14 +256,15 @@ extern int BaseThread();
                 }                                                              \
 
 
-#define         DISK_READ( arg1, arg2, arg3)   {                               \
+#define         DISK_READ( arg1, arg2, arg3, arg4 )   {                         \
                 SYSTEM_CALL_DATA *SystemCallData =                             \
                      (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
-                SystemCallData->NumberOfArguments = 4;                         \
+                SystemCallData->NumberOfArguments = 5;                         \
                 SystemCallData->SystemCallNumber = SYSNUM_DISK_READ;           \
-                SystemCallData->Argument[0] = (long *)arg1;                    \
-                SystemCallData->Argument[1] = (long *)arg2;                    \
-                SystemCallData->Argument[2] = (long *)arg3;                    \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
                 ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
                 Z502_MODE = KERNEL_MODE;                                       \
                 svc(SystemCallData);                                           \
@@ -213,14 +273,186 @@ extern int BaseThread();
                 }                                                              \
 
 
-#define         DISK_WRITE( arg1, arg2, arg3)   {                              \
+#define         DISK_WRITE( arg1, arg2, arg3, arg4 )   {                        \
                 SYSTEM_CALL_DATA *SystemCallData =                             \
                      (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
-                SystemCallData->NumberOfArguments = 4;                         \
+                SystemCallData->NumberOfArguments = 5;                         \
                 SystemCallData->SystemCallNumber = SYSNUM_DISK_WRITE;          \
-                SystemCallData->Argument[0] = (long *)arg1;                    \
-                SystemCallData->Argument[1] = (long *)arg2;                    \
-                SystemCallData->Argument[2] = (long *)arg3;                    \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         DEFINE_SHARED_AREA( arg1, arg2, arg3, arg4, arg5 )   {         \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 6;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_DEFINE_SHARED_AREA;  \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
+                SystemCallData->Argument[4] = (long *)(long)arg5;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         FORK_PROCESS( arg1, arg2, arg3, arg4, arg5 )   {               \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 6;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_FORK_PROCESS;        \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
+                SystemCallData->Argument[4] = (long *)(long)arg5;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         MEMORY_ADVICE( arg1, arg2, arg3, arg4 )   {                    \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 5;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_MEMORY_ADVICE;       \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         MAP_DISK( arg1, arg2, arg3, arg4, arg5 )   {                   \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 6;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_MAP_DISK;            \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
+                SystemCallData->Argument[4] = (long *)(long)arg5;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         SYNC_DISK( arg1, arg2, arg3 )   {                              \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 4;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_SYNC_DISK;           \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         REGISTER_USERFAULT( arg1, arg2, arg3, arg4 )   {               \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 5;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_REGISTER_USERFAULT;  \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         RECEIVE_FAULT( arg1, arg2, arg3 )   {                          \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 4;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_RECEIVE_FAULT;       \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         INSTALL_PAGE( arg1, arg2, arg3, arg4, arg5 )   {               \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 6;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_INSTALL_PAGE;        \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
+                SystemCallData->Argument[4] = (long *)(long)arg5;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         GET_PAGING_STATS( arg1, arg2, arg3 )   {                       \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 4;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_GET_PAGING_STATS;    \
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
+                Z502_MODE = KERNEL_MODE;                                       \
+                svc(SystemCallData);                                           \
+                Z502_MODE = USER_MODE;                                         \
+                free(SystemCallData);                                          \
+                }                                                              \
+
+
+#define         SET_PAGING_PARAMETER( arg1, arg2, arg3, arg4 )   {             \
+                SYSTEM_CALL_DATA *SystemCallData =                             \
+                     (SYSTEM_CALL_DATA *)calloc(1, sizeof (SYSTEM_CALL_DATA)); \
+                SystemCallData->NumberOfArguments = 5;                         \
+                SystemCallData->SystemCallNumber = SYSNUM_SET_PAGING_PARAMETER;\
+                SystemCallData->Argument[0] = (long *)(long)arg1;              \
+                SystemCallData->Argument[1] = (long *)(long)arg2;              \
+                SystemCallData->Argument[2] = (long *)(long)arg3;              \
+                SystemCallData->Argument[3] = (long *)(long)arg4;              \
                 ChargeTimeAndCheckEvents( COST_OF_SOFTWARE_TRAP );             \
                 Z502_MODE = KERNEL_MODE;                                       \
                 svc(SystemCallData);                                           \
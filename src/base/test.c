@@ -36,6 +36,12 @@ extern INT16 Z502_MODE;
 
 void test1x(void);
 void test2hx(void);
+void test2ix(void);
+void test2mx(void);
+void test2nx(void);
+void test2px(void);
+void test2qx(void);
+void test2rx(void);
 void ErrorExpected(INT32, char[]);
 void SuccessExpected(INT32, char[]);
 void get_skewed_random_number(long *, long);
@@ -683,7 +689,7 @@ void test2a(void)
 
 void test2b(void)
 {
-    static INT32 test_data[TEST_DATA_SIZE ] = {0, 4, PGSIZE - 2, PGSIZE, 3
+    INT32 test_data[TEST_DATA_SIZE ] = {0, 4, PGSIZE - 2, PGSIZE, 3
         * PGSIZE - 2, (VIRTUAL_MEM_PGS - 1) * PGSIZE, VIRTUAL_MEM_PGS
         * PGSIZE - 2};
 
@@ -772,12 +778,12 @@ void test2c(void)
         data_written->int_data[1] = sanity;
         data_written->int_data[2] = sector;
         data_written->int_data[3] = (int) Z502_REG4;
-        DISK_WRITE(disk_id, sector, (char*) (data_written->char_data));
+        DISK_WRITE(disk_id, sector, (char*) (data_written->char_data), &Z502_REG9);
 
         // Now read back the same data.  Note that we assume the
         // disk_id and sector have not been modified by the previous
         // call.
-        DISK_READ(disk_id, sector, (char*) (data_read->char_data));
+        DISK_READ(disk_id, sector, (char*) (data_read->char_data), &Z502_REG9);
 
         if ((data_read->int_data[0] != data_written->int_data[0])
                 || (data_read->int_data[1] != data_written->int_data[1])
@@ -807,7 +813,7 @@ void test2c(void)
         data_written->int_data[2] = sector;
         data_written->int_data[3] = Z502_REG4;
 
-        DISK_READ(disk_id, sector, (char*) (data_read->char_data));
+        DISK_READ(disk_id, sector, (char*) (data_read->char_data), &Z502_REG9);
 
         if ((data_read->int_data[0] != data_written->int_data[0])
                 || (data_read->int_data[1] != data_written->int_data[1])
@@ -1068,6 +1074,1119 @@ void test2g(void)
 
 } // End test2g
 
+/**************************************************************************
+ Test2h
+
+ Tests shared memory.  test2h starts several copies of test2hx,
+ which all define the same shared area.  Each one writes a mark
+ into its own cell of the area, then touches enough private
+ memory to push the shared pages out, and finally reads back the
+ cells of all the others.
+
+ Z502_REG1, 2, 3, 4, 5  Used as return of process id's.
+ Z502_REG6              Return of PID on GET_PROCESS_ID
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         PRIORITY2H              10
+#define         NUMBER_OF_2HX_PROCESSES 5
+#define         SHARED_AREA_START_2H    (VIRTUAL_MEM_PGS / 2 * PGSIZE)
+#define         SHARED_AREA_PAGES_2H    8
+#define         SHARED_CELL_MARK_2H     1000
+#define         PRIVATE_PAGES_2H        (2 * ALL_MEM_PGS)
+
+void test2h(void)
+{
+    static long sleep_time = 1000;
+    char process_name[16];
+    int Index;
+
+    printf("This is Release %s:  Test 2h\n", CURRENT_REL);
+    CREATE_PROCESS("test2h_a", test2hx, PRIORITY2H, &Z502_REG1, &Z502_REG9);
+    CREATE_PROCESS("test2h_b", test2hx, PRIORITY2H, &Z502_REG2, &Z502_REG9);
+    CREATE_PROCESS("test2h_c", test2hx, PRIORITY2H, &Z502_REG3, &Z502_REG9);
+    CREATE_PROCESS("test2h_d", test2hx, PRIORITY2H, &Z502_REG4, &Z502_REG9);
+    CREATE_PROCESS("test2h_e", test2hx, PRIORITY2H, &Z502_REG5, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "CREATE_PROCESS");
+
+    // Wait for each child in turn, until GET_PROCESS_ID no longer finds it.
+    for (Index = 0; Index < NUMBER_OF_2HX_PROCESSES; Index++)
+    {
+        sprintf(process_name, "test2h_%c", 'a' + Index);
+        Z502_REG9 = ERR_SUCCESS;
+        while (Z502_REG9 == ERR_SUCCESS)
+        {
+            SLEEP(sleep_time);
+            GET_PROCESS_ID(process_name, &Z502_REG6, &Z502_REG9);
+        }
+    }
+    TERMINATE_PROCESS(-2, &Z502_REG9); // Terminate all
+
+} // End test2h
+
+void test2hx(void)
+{
+    long Index;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    DEFINE_SHARED_AREA(SHARED_AREA_START_2H, SHARED_AREA_PAGES_2H,
+                       "SharedArea2h", &Z502_REG5, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "DEFINE_SHARED_AREA");
+    printf("\n\nRelease %s:Test 2hx: Pid %ld has shared id %ld\n", CURRENT_REL,
+           Z502_REG4, Z502_REG5);
+
+    // Mark our own cell, one page of the area per process.
+    Z502_REG3 = SHARED_AREA_START_2H + Z502_REG5 * PGSIZE;
+    Z502_REG1 = SHARED_CELL_MARK_2H + Z502_REG5;
+    MEM_WRITE(Z502_REG3, &Z502_REG1);
+
+    // Touch more private pages than there are frames, so the shared
+    // pages are evicted and have to be brought back in.
+    for (Index = 0; Index < PRIVATE_PAGES_2H; Index++)
+    {
+        Z502_REG3 = PGSIZE * Index;
+        Z502_REG1 = Z502_REG3 + Z502_REG4;
+        MEM_WRITE(Z502_REG3, &Z502_REG1);
+    }
+
+    // Read the cells of all processes, waiting for those not marked yet.
+    for (Index = 0; Index < NUMBER_OF_2HX_PROCESSES; Index++)
+    {
+        Z502_REG3 = SHARED_AREA_START_2H + Index * PGSIZE;
+        MEM_READ(Z502_REG3, &Z502_REG2);
+        while (Z502_REG2 == 0)
+        {
+            SLEEP(100);
+            MEM_READ(Z502_REG3, &Z502_REG2);
+        }
+        printf("PID= %ld  shared cell= %ld   read= %ld\n", Z502_REG4, Index,
+               Z502_REG2);
+        if (Z502_REG2 != SHARED_CELL_MARK_2H + Index)
+            printf("AN ERROR HAS OCCURRED: SHARED CELL NOT AS WRITTEN.\n");
+    }
+
+    // Our private pages must still hold what we wrote.
+    for (Index = 0; Index < PRIVATE_PAGES_2H; Index++)
+    {
+        Z502_REG3 = PGSIZE * Index;
+        MEM_READ(Z502_REG3, &Z502_REG2);
+        if (Z502_REG2 != Z502_REG3 + Z502_REG4)
+            printf("ERROR HAS OCCURRED: READ NOT SAME AS WRITE.\n");
+    }
+    TERMINATE_PROCESS(-1, &Z502_REG9);
+
+} // End test2hx
+
+/**************************************************************************
+ Test2i
+
+ Tests copy-on-write forks.  test2i writes a set of pages, then forks
+ several copies of test2ix, which see those pages as they were at the
+ fork.  The parent and every child then overwrite some of the pages;
+ nobody may see the writes of another.  The children also touch more
+ private pages than there are frames, so pages still shared are
+ evicted as well.
+
+ Z502_REG1, 2, 3        Used as return of process id's.
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6, 7        Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         PRIORITY2I              10
+#define         NUMBER_OF_2IX_PROCESSES 3
+#define         FORKED_PAGES_2I         (ALL_MEM_PGS / 2)
+#define         FORK_MARK_2I            5000
+#define         PRIVATE_START_2I        (VIRTUAL_MEM_PGS / 2 * PGSIZE)
+#define         PRIVATE_PAGES_2I        ALL_MEM_PGS
+
+void test2i(void)
+{
+    static long sleep_time = 1000;
+    char process_name[16];
+    int Index;
+
+    printf("This is Release %s:  Test 2i\n", CURRENT_REL);
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    for (Index = 0; Index < FORKED_PAGES_2I; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + FORK_MARK_2I;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+
+    FORK_PROCESS("test2i_a", test2ix, PRIORITY2I, &Z502_REG1, &Z502_REG9);
+    FORK_PROCESS("test2i_b", test2ix, PRIORITY2I, &Z502_REG2, &Z502_REG9);
+    FORK_PROCESS("test2i_c", test2ix, PRIORITY2I, &Z502_REG3, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "FORK_PROCESS");
+
+    // Overwrite the even pages, the children must still see the old data.
+    for (Index = 0; Index < FORKED_PAGES_2I; Index += 2)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+
+    // Wait for each child in turn, until GET_PROCESS_ID no longer finds it.
+    for (Index = 0; Index < NUMBER_OF_2IX_PROCESSES; Index++)
+    {
+        sprintf(process_name, "test2i_%c", 'a' + Index);
+        Z502_REG9 = ERR_SUCCESS;
+        while (Z502_REG9 == ERR_SUCCESS)
+        {
+            SLEEP(sleep_time);
+            GET_PROCESS_ID(process_name, &Z502_REG7, &Z502_REG9);
+        }
+    }
+
+    // Neither the writes of the children nor their exit may change our pages.
+    for (Index = 0; Index < FORKED_PAGES_2I; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        Z502_REG7 = Z502_REG5 + (Index % 2 ? FORK_MARK_2I : Z502_REG4);
+        if (Z502_REG6 != Z502_REG7)
+            printf("AN ERROR HAS OCCURRED: PARENT PAGE %d CHANGED.\n", Index);
+    }
+    printf("PID= %ld  checked %d pages after the children ended\n", Z502_REG4,
+           FORKED_PAGES_2I);
+    TERMINATE_PROCESS(-2, &Z502_REG9); // Terminate all
+
+} // End test2i
+
+void test2ix(void)
+{
+    long Index;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2ix: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    // Every page must hold what the parent wrote before the fork.
+    for (Index = 0; Index < FORKED_PAGES_2I; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        if (Z502_REG6 != Z502_REG5 + FORK_MARK_2I)
+            printf("AN ERROR HAS OCCURRED: FORKED PAGE NOT AS WRITTEN.\n");
+    }
+
+    // Overwrite the pages a third of the way, each child its own third.
+    for (Index = Z502_REG4 % 3; Index < FORKED_PAGES_2I; Index += 3)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+
+    // Touch more private pages than there are frames, so the pages still
+    // shared with the parent are evicted and have to be brought back in.
+    for (Index = 0; Index < PRIVATE_PAGES_2I; Index++)
+    {
+        Z502_REG5 = PRIVATE_START_2I + PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+
+    for (Index = 0; Index < FORKED_PAGES_2I; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        Z502_REG7 = Z502_REG5 + (Index % 3 == Z502_REG4 % 3 ? Z502_REG4 : FORK_MARK_2I);
+        if (Z502_REG6 != Z502_REG7)
+            printf("AN ERROR HAS OCCURRED: FORKED PAGE %ld SEES ANOTHER WRITE.\n", Index);
+    }
+    printf("PID= %ld  checked %d forked pages\n", Z502_REG4, FORKED_PAGES_2I);
+    TERMINATE_PROCESS(-1, &Z502_REG9);
+
+} // End test2ix
+
+/**************************************************************************
+
+ Test2j
+
+ Sweeps a dense array, one word after the other, several times.  The
+ array takes three quarters of the frames, so it stays resident.  Once
+ the first blocks of the array are filled, the OS can map the rest
+ with large pages, and while the test sleeps it can collapse the
+ blocks mapped page by page, so the later sweeps take few faults and
+ few TLB misses.  Every word must read back as written.
+
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6, 7        Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         DENSE_PAGES_2J          (ALL_MEM_PGS * 3 / 4)
+#define         SWEEPS_2J               4
+
+void test2j(void)
+{
+    static long sleep_time = 100;
+    long Index;
+    int Sweep;
+
+    printf("This is Release %s:  Test 2j\n", CURRENT_REL);
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    for (Index = 0; Index < DENSE_PAGES_2J * PGSIZE; Index += 4)
+    {
+        Z502_REG5 = Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+
+    for (Sweep = 0; Sweep < SWEEPS_2J; Sweep++)
+    {
+        SLEEP(sleep_time);
+        for (Index = 0; Index < DENSE_PAGES_2J * PGSIZE; Index += 4)
+        {
+            Z502_REG5 = Index;
+            MEM_READ(Z502_REG5, &Z502_REG6);
+            Z502_REG7 = Z502_REG5 + Z502_REG4;
+            if (Z502_REG6 != Z502_REG7)
+                printf("AN ERROR HAS OCCURRED: ADDRESS %ld READ %ld.\n", Z502_REG5,
+                       Z502_REG6);
+        }
+    }
+    printf("PID= %ld  swept %d pages %d times\n", Z502_REG4, DENSE_PAGES_2J,
+           SWEEPS_2J);
+    TERMINATE_PROCESS(-2, &Z502_REG9);
+
+} // End test2j
+
+/**************************************************************************
+
+ Test2k
+
+ Gives the OS hints on how its pages are going to be used.  The test
+ fills more pages than memory holds, then reads them back as a
+ sequential range, so the OS reads ahead and drops the pages behind.
+ It asks for the first pages to be fetched before it reads them, lets
+ go of the second half, which must read back as zeros, and reads the
+ first half again in random order.  Every other page must read back
+ as written.
+
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6, 7        Addresses and data.
+ Z502_REG8              Random page number.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         ADVISED_PAGES_2K        (2 * ALL_MEM_PGS)
+#define         RANDOM_READS_2K         200
+
+void test2k(void)
+{
+    static long sleep_time = 100;
+    long Index;
+
+    printf("This is Release %s:  Test 2k\n", CURRENT_REL);
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    for (Index = 0; Index < ADVISED_PAGES_2K; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+
+    // A range which is not page aligned is refused.
+    MEMORY_ADVICE((PGSIZE / 2), ADVISED_PAGES_2K, ADVICE_SEQUENTIAL, &Z502_REG9);
+    ErrorExpected(Z502_REG9, "MEMORY_ADVICE");
+
+    MEMORY_ADVICE(0, ADVISED_PAGES_2K, ADVICE_SEQUENTIAL, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "MEMORY_ADVICE");
+    for (Index = 0; Index < ADVISED_PAGES_2K; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        Z502_REG7 = Z502_REG5 + Z502_REG4;
+        if (Z502_REG6 != Z502_REG7)
+            printf("AN ERROR HAS OCCURRED: SEQUENTIAL PAGE %ld READ %ld.\n", Index,
+                   Z502_REG6);
+    }
+
+    MEMORY_ADVICE(0, (ADVISED_PAGES_2K / 4), ADVICE_WILLNEED, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "MEMORY_ADVICE");
+    SLEEP(sleep_time);
+    for (Index = 0; Index < ADVISED_PAGES_2K / 4; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        Z502_REG7 = Z502_REG5 + Z502_REG4;
+        if (Z502_REG6 != Z502_REG7)
+            printf("AN ERROR HAS OCCURRED: PREFETCHED PAGE %ld READ %ld.\n", Index,
+                   Z502_REG6);
+    }
+
+    MEMORY_ADVICE((PGSIZE * (ADVISED_PAGES_2K / 2)), (ADVISED_PAGES_2K / 2),
+                  ADVICE_DONTNEED, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "MEMORY_ADVICE");
+    for (Index = ADVISED_PAGES_2K / 2; Index < ADVISED_PAGES_2K; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        if (Z502_REG6 != 0)
+            printf("AN ERROR HAS OCCURRED: DROPPED PAGE %ld READ %ld.\n", Index,
+                   Z502_REG6);
+    }
+
+    MEMORY_ADVICE(0, (ADVISED_PAGES_2K / 2), ADVICE_RANDOM, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "MEMORY_ADVICE");
+    for (Index = 0; Index < RANDOM_READS_2K; Index++)
+    {
+        get_skewed_random_number(&Z502_REG8, ADVISED_PAGES_2K / 2);
+        Z502_REG5 = PGSIZE * Z502_REG8;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        Z502_REG7 = Z502_REG5 + Z502_REG4;
+        if (Z502_REG6 != Z502_REG7)
+            printf("AN ERROR HAS OCCURRED: RANDOM PAGE %ld READ %ld.\n", Z502_REG8,
+                   Z502_REG6);
+    }
+    printf("PID= %ld  advised %d pages\n", Z502_REG4, ADVISED_PAGES_2K);
+    TERMINATE_PROCESS(-2, &Z502_REG9);
+
+} // End test2k
+
+/**************************************************************************
+
+ Test2l
+
+ Maps sectors of a disk into memory.  The test writes a word into
+ every page of a mapped range larger than memory, so part of it is
+ written back to the disk on eviction, and syncs the rest.  Reading
+ the sectors back with DISK_READ must then find every word.  Sectors
+ written with DISK_WRITE and mapped at another address must read
+ back as written.  The swap area after the logical sectors can be
+ neither read, written nor mapped.
+
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6, 7        Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         MAPPED_PAGES_2L         (2 * ALL_MEM_PGS)
+#define         MAPPED_START_2L         (VIRTUAL_MEM_PGS / 2)
+#define         MAPPED_DISK_2L          1
+#define         REMAPPED_PAGES_2L       8
+#define         REMAPPED_START_2L       (VIRTUAL_MEM_PGS / 8)
+
+void test2l(void)
+{
+    DISK_DATA *data;
+    long Index;
+
+    data = (DISK_DATA *) calloc(1, sizeof (DISK_DATA));
+    printf("This is Release %s:  Test 2l\n", CURRENT_REL);
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+
+    // The swap area of the disk cannot be reached.
+    MAP_DISK((PGSIZE * MAPPED_START_2L), MAPPED_PAGES_2L, MAPPED_DISK_2L,
+             (NUM_LOGICAL_SECTORS - 1), &Z502_REG9);
+    ErrorExpected(Z502_REG9, "MAP_DISK");
+    DISK_WRITE(MAPPED_DISK_2L, NUM_LOGICAL_SECTORS, (char*) (data->char_data), &Z502_REG9);
+    ErrorExpected(Z502_REG9, "DISK_WRITE");
+    DISK_READ(MAPPED_DISK_2L, (NUM_DISK_SECTORS - 1), (char*) (data->char_data), &Z502_REG9);
+    ErrorExpected(Z502_REG9, "DISK_READ");
+
+    MAP_DISK((PGSIZE * MAPPED_START_2L), MAPPED_PAGES_2L, MAPPED_DISK_2L, 0,
+             &Z502_REG9);
+    SuccessExpected(Z502_REG9, "MAP_DISK");
+    for (Index = 0; Index < MAPPED_PAGES_2L; Index++)
+    {
+        Z502_REG5 = PGSIZE * (MAPPED_START_2L + Index);
+        Z502_REG6 = Index + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+    SYNC_DISK((PGSIZE * MAPPED_START_2L), MAPPED_PAGES_2L, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "SYNC_DISK");
+
+    for (Index = 0; Index < MAPPED_PAGES_2L; Index++)
+    {
+        DISK_READ(MAPPED_DISK_2L, Index, (char*) (data->char_data), &Z502_REG9);
+        if (data->int_data[0] != Index + Z502_REG4)
+            printf("AN ERROR HAS OCCURRED: SECTOR %ld READ %d.\n", Index,
+                   data->int_data[0]);
+    }
+
+    for (Index = 0; Index < REMAPPED_PAGES_2L; Index++)
+    {
+        data->int_data[0] = Index * 3 + Z502_REG4;
+        DISK_WRITE(MAPPED_DISK_2L, Index, (char*) (data->char_data), &Z502_REG9);
+    }
+    MAP_DISK((PGSIZE * REMAPPED_START_2L), REMAPPED_PAGES_2L, MAPPED_DISK_2L, 0,
+             &Z502_REG9);
+    SuccessExpected(Z502_REG9, "MAP_DISK");
+    for (Index = 0; Index < REMAPPED_PAGES_2L; Index++)
+    {
+        Z502_REG5 = PGSIZE * (REMAPPED_START_2L + Index);
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        Z502_REG7 = Index * 3 + Z502_REG4;
+        if (Z502_REG6 != Z502_REG7)
+            printf("AN ERROR HAS OCCURRED: MAPPED PAGE %ld READ %ld.\n", Index,
+                   Z502_REG6);
+    }
+    printf("PID= %ld  mapped %d sectors\n", Z502_REG4, MAPPED_PAGES_2L);
+    free(data);
+    TERMINATE_PROCESS(-2, &Z502_REG9);
+
+} // End test2l
+
+/**************************************************************************
+
+ Test2m
+
+ Hands the faults of a range to a user-level handler.  test2m creates
+ test2mx and registers a range of its pages with it as the handler.
+ Every page of the range read by test2m must then hold what test2mx
+ installed: test2mx copies some pages from a buffer, moves others
+ over from its own memory, and installs some before they fault.  The
+ pages are then evicted by touching more pages than there are frames,
+ and must still read back the same.
+
+ Z502_REG1              Used as return of process id's.
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6, 7        Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         PRIORITY2M              10
+#define         USERFAULT_PAGES_2M      32
+#define         USERFAULT_START_2M      (VIRTUAL_MEM_PGS / 4)
+#define         USERFAULT_MARK_2M       7000
+#define         MOVED_PAGE_2M           (VIRTUAL_MEM_PGS / 2)
+#define         OTHER_START_2M          (VIRTUAL_MEM_PGS / 2 + 1)
+#define         OTHER_PAGES_2M          (2 * ALL_MEM_PGS)
+
+void test2m(void)
+{
+    long Index;
+
+    printf("This is Release %s:  Test 2m\n", CURRENT_REL);
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    CREATE_PROCESS("test2m_a", test2mx, PRIORITY2M, &Z502_REG1, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "CREATE_PROCESS");
+
+    // A process cannot handle its own faults.
+    REGISTER_USERFAULT((PGSIZE * USERFAULT_START_2M), USERFAULT_PAGES_2M,
+                       Z502_REG4, &Z502_REG9);
+    ErrorExpected(Z502_REG9, "REGISTER_USERFAULT");
+
+    REGISTER_USERFAULT((PGSIZE * USERFAULT_START_2M), USERFAULT_PAGES_2M,
+                       Z502_REG1, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "REGISTER_USERFAULT");
+    for (Index = 0; Index < USERFAULT_PAGES_2M; Index++)
+    {
+        Z502_REG5 = PGSIZE * (USERFAULT_START_2M + Index);
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        Z502_REG7 = Z502_REG5 + USERFAULT_MARK_2M;
+        if (Z502_REG6 != Z502_REG7)
+            printf("AN ERROR HAS OCCURRED: PAGE %ld READ %ld.\n", Index,
+                   Z502_REG6);
+    }
+
+    for (Index = 0; Index < OTHER_PAGES_2M; Index++)
+    {
+        Z502_REG5 = PGSIZE * (OTHER_START_2M + Index);
+        MEM_WRITE(Z502_REG5, &Z502_REG5);
+    }
+    for (Index = 0; Index < USERFAULT_PAGES_2M; Index++)
+    {
+        Z502_REG5 = PGSIZE * (USERFAULT_START_2M + Index);
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        Z502_REG7 = Z502_REG5 + USERFAULT_MARK_2M;
+        if (Z502_REG6 != Z502_REG7)
+            printf("AN ERROR HAS OCCURRED: EVICTED PAGE %ld READ %ld.\n",
+                   Index, Z502_REG6);
+    }
+    printf("PID= %ld  had %d pages installed\n", Z502_REG4, USERFAULT_PAGES_2M);
+    TERMINATE_PROCESS(-2, &Z502_REG9); // Terminate all
+
+} // End test2m
+
+void test2mx(void)
+{
+    DISK_DATA *data;
+    long Index;
+
+    data = (DISK_DATA *) calloc(1, sizeof (DISK_DATA));
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2mx: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    for (;;)
+    {
+        RECEIVE_FAULT(&Z502_REG1, &Z502_REG5, &Z502_REG9);
+        if (Z502_REG9 != ERR_SUCCESS)
+            break;
+        Index = Z502_REG5 / PGSIZE - USERFAULT_START_2M;
+        Z502_REG6 = Z502_REG5 + USERFAULT_MARK_2M;
+
+        // Move every fourth page over from our own memory, copy the others.
+        if (Index % 4 == 2)
+        {
+            Z502_REG7 = PGSIZE * MOVED_PAGE_2M;
+            MEM_WRITE(Z502_REG7, &Z502_REG6);
+            INSTALL_PAGE(Z502_REG1, Z502_REG5, USERFAULT_MAP, Z502_REG7,
+                         &Z502_REG9);
+        }
+        else
+        {
+            data->int_data[0] = (UINT32) Z502_REG6;
+            INSTALL_PAGE(Z502_REG1, Z502_REG5, USERFAULT_COPY,
+                         (long) data->char_data, &Z502_REG9);
+        }
+        SuccessExpected(Z502_REG9, "INSTALL_PAGE");
+
+        // Install the next page before it faults.
+        if (Index % 4 == 0 && Index + 1 < USERFAULT_PAGES_2M)
+        {
+            data->int_data[0] = (UINT32) (Z502_REG6 + PGSIZE);
+            INSTALL_PAGE(Z502_REG1, (Z502_REG5 + PGSIZE), USERFAULT_COPY,
+                         (long) data->char_data, &Z502_REG9);
+            SuccessExpected(Z502_REG9, "INSTALL_PAGE");
+        }
+    }
+    free(data);
+    TERMINATE_PROCESS(-1, &Z502_REG9);
+
+} // End test2mx
+
+/**************************************************************************
+
+ Test2n
+
+ Checks that a low priority process scanning memory does not evict the
+ hot pages of a high priority one.  test2n lowers its own priority and
+ creates test2nx at a high priority.  test2nx keeps touching a small
+ set of pages, sleeping in between, while test2n writes over more
+ pages than there are frames.  The faults of each priority are printed
+ at the end; test2nx should take few faults once its pages are in.
+
+ Z502_REG1              Used as return of process id's.
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6, 7        Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         PRIORITY2N_HOT          2
+#define         PRIORITY2N_SCAN         40
+#define         HOT_PAGES_2N            12
+#define         HOT_ROUNDS_2N           8
+#define         HOT_SLEEP_2N            2500
+#define         SCAN_START_2N           (VIRTUAL_MEM_PGS / 2)
+#define         SCAN_PAGES_2N           (2 * ALL_MEM_PGS)
+#define         SCAN_ROUNDS_2N          3
+
+void test2n(void)
+{
+    static long sleep_time = 1000;
+    long Index;
+    int Round;
+
+    printf("This is Release %s:  Test 2n\n", CURRENT_REL);
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    CHANGE_PRIORITY(-1, PRIORITY2N_SCAN, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "CHANGE_PRIORITY");
+    CREATE_PROCESS("test2n_a", test2nx, PRIORITY2N_HOT, &Z502_REG1, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "CREATE_PROCESS");
+
+    for (Round = 0; Round < SCAN_ROUNDS_2N; Round++)
+    {
+        for (Index = 0; Index < SCAN_PAGES_2N; Index++)
+        {
+            Z502_REG5 = PGSIZE * (SCAN_START_2N + Index);
+            Z502_REG6 = Z502_REG5 + Round;
+            MEM_WRITE(Z502_REG5, &Z502_REG6);
+        }
+    }
+
+    // Wait for the child, until GET_PROCESS_ID no longer finds it.
+    Z502_REG9 = ERR_SUCCESS;
+    while (Z502_REG9 == ERR_SUCCESS)
+    {
+        SLEEP(sleep_time);
+        GET_PROCESS_ID("test2n_a", &Z502_REG7, &Z502_REG9);
+    }
+    printf("PID= %ld  scanned %d pages %d times\n", Z502_REG4, SCAN_PAGES_2N,
+           SCAN_ROUNDS_2N);
+    TERMINATE_PROCESS(-2, &Z502_REG9); // Terminate all
+
+} // End test2n
+
+void test2nx(void)
+{
+    long Index;
+    int Round;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2nx: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    for (Round = 0; Round < HOT_ROUNDS_2N; Round++)
+    {
+        for (Index = 0; Index < HOT_PAGES_2N; Index++)
+        {
+            Z502_REG5 = PGSIZE * Index;
+            Z502_REG7 = Z502_REG5 + Z502_REG4;
+            if (Round == 0)
+                MEM_WRITE(Z502_REG5, &Z502_REG7);
+            MEM_READ(Z502_REG5, &Z502_REG6);
+            if (Z502_REG6 != Z502_REG7)
+                printf("AN ERROR HAS OCCURRED: HOT PAGE %ld READ %ld.\n",
+                       Index, Z502_REG6);
+        }
+        SLEEP(HOT_SLEEP_2N);
+    }
+    TERMINATE_PROCESS(-1, &Z502_REG9);
+
+} // End test2nx
+
+/**************************************************************************
+
+ Test2o
+
+ Reads the paging statistics.  test2o writes more pages than there
+ are frames and reads them all back, so pages are evicted and read
+ in again.  GET_PAGING_STATS must then report major and minor faults,
+ clean and dirty evictions, page-ins and page-outs, a latency for
+ every fault, and no more for the process than for the system.
+
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6           Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         TOUCHED_PAGES_2O        (2 * ALL_MEM_PGS)
+
+void test2o(void)
+{
+    PAGING_STATS own;
+    PAGING_STATS all;
+    long Index;
+    INT32 latencies = 0;
+
+    printf("This is Release %s:  Test 2o\n", CURRENT_REL);
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+
+    GET_PAGING_STATS((INT32) 9999, &own, &Z502_REG9);
+    ErrorExpected(Z502_REG9, "GET_PAGING_STATS");
+
+    for (Index = 0; Index < TOUCHED_PAGES_2O; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_WRITE(Z502_REG5, &Z502_REG5);
+    }
+    // Read every other page first, so the rest are evicted without a write.
+    for (Index = 0; Index < TOUCHED_PAGES_2O; Index++)
+    {
+        Z502_REG5 = PGSIZE * (Index % 2 ? Index : TOUCHED_PAGES_2O - 1 - Index);
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        if (Z502_REG6 != Z502_REG5)
+            printf("AN ERROR HAS OCCURRED: PAGE %ld READ %ld.\n",
+                   Z502_REG5 / PGSIZE, Z502_REG6);
+    }
+
+    GET_PAGING_STATS(PAGING_STATS_SELF, &own, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "GET_PAGING_STATS");
+    GET_PAGING_STATS(PAGING_STATS_SYSTEM, &all, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "GET_PAGING_STATS");
+    for (Index = 0; Index < FAULT_LATENCY_BUCKETS; Index++)
+        latencies += own.fault_latency[Index];
+    if (own.major_faults == 0 || own.minor_faults == 0
+            || own.clean_evictions == 0 || own.dirty_evictions == 0
+            || own.page_ins == 0 || own.page_outs == 0
+            || latencies != own.major_faults + own.minor_faults)
+        printf("AN ERROR HAS OCCURRED: PAGING STATS DO NOT ADD UP.\n");
+    if (own.major_faults > all.major_faults || own.page_ins > all.page_ins
+            || own.free_frames_low_water != all.free_frames_low_water)
+        printf("AN ERROR HAS OCCURRED: PROCESS STATS EXCEED THE SYSTEM.\n");
+    printf("PID= %ld  %d major faults, %d minor faults, %d clean and %d dirty evictions\n",
+           Z502_REG4, own.major_faults, own.minor_faults, own.clean_evictions,
+           own.dirty_evictions);
+    TERMINATE_PROCESS(-2, &Z502_REG9);
+
+} // End test2o
+
+/**************************************************************************
+
+ Test2p
+
+ Terminates processes in the middle of their paging.  Each copy of
+ test2px writes more pages than there are frames until it is
+ terminated, so it is usually waiting for a page-in or a write back
+ when test2p terminates it.  The process must still go away, and a
+ new process which gets its pid must start with no paging statistics.
+
+ Z502_REG1              Process id of the process to terminate.
+ Z502_REG2              Process id of the last process.
+ Z502_REG5, 6           Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         PRIORITY2P              10
+#define         NUMBER_OF_2PX_PROCESSES 3
+#define         PRIVATE_PAGES_2P        (2 * ALL_MEM_PGS)
+
+void test2p(void)
+{
+    static long sleep_time = 200;
+    long kill_time;
+    char process_name[16];
+    PAGING_STATS stats;
+    long Index;
+    int Kill;
+
+    printf("This is Release %s:  Test 2p\n", CURRENT_REL);
+    for (Kill = 0; Kill < NUMBER_OF_2PX_PROCESSES; Kill++)
+    {
+        sprintf(process_name, "test2p_%c", 'a' + Kill);
+        CREATE_PROCESS(process_name, test2px, PRIORITY2P, &Z502_REG1, &Z502_REG9);
+        SuccessExpected(Z502_REG9, "CREATE_PROCESS");
+        kill_time = sleep_time * (Kill + 1);
+        SLEEP(kill_time);
+        TERMINATE_PROCESS(Z502_REG1, &Z502_REG9);
+        SuccessExpected(Z502_REG9, "TERMINATE_PROCESS");
+
+        // Wait until the process is really gone, then its pid is free.
+        while (Z502_REG9 == ERR_SUCCESS)
+        {
+            SLEEP(sleep_time);
+            GET_PROCESS_ID(process_name, &Z502_REG6, &Z502_REG9);
+        }
+        TERMINATE_PROCESS(Z502_REG1, &Z502_REG9);
+        ErrorExpected(Z502_REG9, "TERMINATE_PROCESS");
+    }
+
+    // The pid of the terminated processes is free again.
+    CREATE_PROCESS("test2p_z", test2px, PRIORITY2P, &Z502_REG2, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "CREATE_PROCESS");
+    GET_PAGING_STATS((INT32) Z502_REG2, &stats, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "GET_PAGING_STATS");
+    if (stats.major_faults || stats.minor_faults || stats.page_ins
+            || stats.page_outs || stats.clean_evictions || stats.dirty_evictions)
+        printf("AN ERROR HAS OCCURRED: NEW PROCESS HAS OLD PAGING STATS.\n");
+    TERMINATE_PROCESS(Z502_REG2, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "TERMINATE_PROCESS");
+
+    // The frames of the terminated processes are back for our own pages.
+    for (Index = 0; Index < PRIVATE_PAGES_2P; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_WRITE(Z502_REG5, &Z502_REG5);
+    }
+    for (Index = 0; Index < PRIVATE_PAGES_2P; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        if (Z502_REG6 != Z502_REG5)
+            printf("AN ERROR HAS OCCURRED: PAGE %ld READ %ld.\n",
+                   Z502_REG5 / PGSIZE, Z502_REG6);
+    }
+    printf("PID= %ld  last process, after %d terminated while paging\n",
+           Z502_REG2, NUMBER_OF_2PX_PROCESSES);
+    TERMINATE_PROCESS(-2, &Z502_REG9);
+
+} // End test2p
+
+void test2px(void)
+{
+    long Index;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2px: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    // Keep writing more pages than there are frames until terminated.
+    for (Index = 0;; Index = (Index + 1) % PRIVATE_PAGES_2P)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+
+} // End test2px
+
+/**************************************************************************
+
+ Test2q
+
+ Tests hard frame quotas.  test2q writes a few pages of its own, then
+ starts test2qx with a quota of QUOTA_2Q frames.  test2qx writes more
+ pages than there are frames, so it has to page, but there are free
+ frames left all along: a process at its quota must still replace its
+ own pages, and test2q must not lose any of its pages.  Quotas below
+ the minimum working set, and unknown parameters and processes, are
+ refused.
+
+ Z502_REG1              Process id of test2qx.
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6           Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         PRIORITY2Q              10
+#define         QUOTA_2Q                8
+#define         OWN_PAGES_2Q            (ALL_MEM_PGS / 4)
+#define         CAPPED_PAGES_2Q         (2 * ALL_MEM_PGS)
+
+void test2q(void)
+{
+    static long sleep_time = 1000;
+    PAGING_STATS stats;
+    long Index;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2q: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    SET_PAGING_PARAMETER(-1, PAGING_PARAMETER_FRAME_QUOTA, 1, &Z502_REG9);
+    ErrorExpected(Z502_REG9, "SET_PAGING_PARAMETER");
+    SET_PAGING_PARAMETER(-1, 99, QUOTA_2Q, &Z502_REG9);
+    ErrorExpected(Z502_REG9, "SET_PAGING_PARAMETER");
+    SET_PAGING_PARAMETER(99, PAGING_PARAMETER_FRAME_QUOTA, QUOTA_2Q, &Z502_REG9);
+    ErrorExpected(Z502_REG9, "SET_PAGING_PARAMETER");
+
+    for (Index = 0; Index < OWN_PAGES_2Q; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+
+    CREATE_PROCESS("test2q_a", test2qx, PRIORITY2Q, &Z502_REG1, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "CREATE_PROCESS");
+    SET_PAGING_PARAMETER(Z502_REG1, PAGING_PARAMETER_FRAME_QUOTA, QUOTA_2Q, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "SET_PAGING_PARAMETER");
+
+    // Wait until test2qx is done.
+    while (Z502_REG9 == ERR_SUCCESS)
+    {
+        SLEEP(sleep_time);
+        GET_PROCESS_ID("test2q_a", &Z502_REG6, &Z502_REG9);
+    }
+
+    GET_PAGING_STATS(PAGING_STATS_SELF, &stats, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "GET_PAGING_STATS");
+    if (stats.clean_evictions || stats.dirty_evictions)
+        printf("AN ERROR HAS OCCURRED: THE CAPPED PROCESS TOOK %d OF OUR PAGES.\n",
+               stats.clean_evictions + stats.dirty_evictions);
+    for (Index = 0; Index < OWN_PAGES_2Q; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        if (Z502_REG6 != Z502_REG5 + Z502_REG4)
+            printf("AN ERROR HAS OCCURRED: PAGE %ld READ %ld.\n",
+                   Index, Z502_REG6);
+    }
+    printf("PID= %ld  kept its %d pages next to a quota of %d\n",
+           Z502_REG4, OWN_PAGES_2Q, QUOTA_2Q);
+    TERMINATE_PROCESS(-2, &Z502_REG9);
+
+} // End test2q
+
+void test2qx(void)
+{
+    PAGING_STATS stats;
+    long Index;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2qx: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    for (Index = 0; Index < CAPPED_PAGES_2Q; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+    for (Index = 0; Index < CAPPED_PAGES_2Q; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        if (Z502_REG6 != Z502_REG5 + Z502_REG4)
+            printf("AN ERROR HAS OCCURRED: PAGE %ld READ %ld.\n",
+                   Index, Z502_REG6);
+    }
+
+    // Every page beyond the quota pushed out one of our own.
+    GET_PAGING_STATS(PAGING_STATS_SELF, &stats, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "GET_PAGING_STATS");
+    if (stats.clean_evictions + stats.dirty_evictions < CAPPED_PAGES_2Q - QUOTA_2Q)
+        printf("AN ERROR HAS OCCURRED: ONLY %d EVICTIONS AT A QUOTA OF %d.\n",
+               stats.clean_evictions + stats.dirty_evictions, QUOTA_2Q);
+    printf("PID= %ld  wrote %d pages at a quota of %d\n", Z502_REG4,
+           CAPPED_PAGES_2Q, QUOTA_2Q);
+    TERMINATE_PROCESS(-1, &Z502_REG9);
+
+} // End test2qx
+
+/**************************************************************************
+
+ Test2r
+
+ Pages with every frame in flight.  As many copies of test2rx as the
+ OS runs next to us write and read back their own pages at once, so
+ most of the frames are being written back or read in while the
+ others fault.  A fault which
+ finds no frame to take must wait for one instead of spinning, or the
+ processes doing the I/O never run again.  Every copy must read back
+ the data it wrote.  Run it with Z502_PHYS_MEM_PGS near MIN_MEM_PGS to
+ put all the frames in flight.
+
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6           Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         PRIORITY2R              10
+#define         NUMBER_OF_2RX_PROCESSES 14
+#define         PRIVATE_PAGES_2R        ALL_MEM_PGS
+
+void test2r(void)
+{
+    static long sleep_time = 1000;
+    char process_name[16];
+    PAGING_STATS stats;
+    int Child;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2r: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    for (Child = 0; Child < NUMBER_OF_2RX_PROCESSES; Child++)
+    {
+        sprintf(process_name, "test2r_%c", 'a' + Child);
+        CREATE_PROCESS(process_name, test2rx, PRIORITY2R, &Z502_REG1, &Z502_REG9);
+        SuccessExpected(Z502_REG9, "CREATE_PROCESS");
+    }
+
+    // Wait until every copy of test2rx is done.
+    for (Child = 0; Child < NUMBER_OF_2RX_PROCESSES; Child++)
+    {
+        sprintf(process_name, "test2r_%c", 'a' + Child);
+        Z502_REG9 = ERR_SUCCESS;
+        while (Z502_REG9 == ERR_SUCCESS)
+        {
+            SLEEP(sleep_time);
+            GET_PROCESS_ID(process_name, &Z502_REG6, &Z502_REG9);
+        }
+    }
+
+    GET_PAGING_STATS(PAGING_STATS_SYSTEM, &stats, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "GET_PAGING_STATS");
+    printf("PID= %ld  %d processes paged in %d frames, %d faults waited for a frame\n",
+           Z502_REG4, NUMBER_OF_2RX_PROCESSES, ALL_MEM_PGS, stats.frame_waits);
+    TERMINATE_PROCESS(-2, &Z502_REG9);
+
+} // End test2r
+
+void test2rx(void)
+{
+    long Index;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2rx: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    for (Index = 0; Index < PRIVATE_PAGES_2R; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        Z502_REG6 = Z502_REG5 + Z502_REG4;
+        MEM_WRITE(Z502_REG5, &Z502_REG6);
+    }
+    for (Index = 0; Index < PRIVATE_PAGES_2R; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        if (Z502_REG6 != Z502_REG5 + Z502_REG4)
+            printf("AN ERROR HAS OCCURRED: PAGE %ld READ %ld.\n",
+                   Index, Z502_REG6);
+    }
+    printf("PID= %ld  read back its %d pages\n", Z502_REG4, PRIVATE_PAGES_2R);
+    TERMINATE_PROCESS(-1, &Z502_REG9);
+
+} // End test2rx
+
+/**************************************************************************
+
+ Test2s
+
+ Turns fault-around off.  test2s writes PAGES_2S new pages with the
+ default block of pages mapped around a fault, so it takes fewer
+ faults than pages.  Then it sets the block to 1 page and writes as
+ many new pages again, which must take one fault each.  All the pages
+ lie in the first large page block, which is never mapped as a large
+ page.  Blocks of no page, or larger than a second level page table,
+ are refused.
+
+ Z502_REG4              Our own process id.
+ Z502_REG5, 6           Addresses and data.
+ Z502_REG9              Used as return of error code.
+
+ **************************************************************************/
+
+#define         PAGES_2S                8
+
+void test2s(void)
+{
+    PAGING_STATS stats;
+    INT32 faults_around;
+    INT32 faults_off;
+    long Index;
+
+    GET_PROCESS_ID("", &Z502_REG4, &Z502_REG9);
+    printf("\n\nRelease %s:Test 2s: Pid %ld\n", CURRENT_REL, Z502_REG4);
+
+    SET_PAGING_PARAMETER(-1, PAGING_PARAMETER_FAULT_AROUND, 0, &Z502_REG9);
+    ErrorExpected(Z502_REG9, "SET_PAGING_PARAMETER");
+    SET_PAGING_PARAMETER(-1, PAGING_PARAMETER_FAULT_AROUND, PTBL_LEAF_ENTRIES + 1,
+                         &Z502_REG9);
+    ErrorExpected(Z502_REG9, "SET_PAGING_PARAMETER");
+
+    for (Index = 0; Index < PAGES_2S; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_WRITE(Z502_REG5, &Z502_REG5);
+    }
+    GET_PAGING_STATS(PAGING_STATS_SELF, &stats, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "GET_PAGING_STATS");
+    faults_around = stats.major_faults + stats.minor_faults;
+
+    SET_PAGING_PARAMETER(-1, PAGING_PARAMETER_FAULT_AROUND, 1, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "SET_PAGING_PARAMETER");
+    for (Index = PAGES_2S; Index < 2 * PAGES_2S; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_WRITE(Z502_REG5, &Z502_REG5);
+    }
+    GET_PAGING_STATS(PAGING_STATS_SELF, &stats, &Z502_REG9);
+    SuccessExpected(Z502_REG9, "GET_PAGING_STATS");
+    faults_off = stats.major_faults + stats.minor_faults - faults_around;
+
+    if (faults_around >= PAGES_2S)
+        printf("AN ERROR HAS OCCURRED: %d FAULTS FOR %d PAGES WITH FAULT-AROUND.\n",
+               faults_around, PAGES_2S);
+    if (faults_off != PAGES_2S)
+        printf("AN ERROR HAS OCCURRED: %d FAULTS FOR %d PAGES WITHOUT FAULT-AROUND.\n",
+               faults_off, PAGES_2S);
+    for (Index = 0; Index < 2 * PAGES_2S; Index++)
+    {
+        Z502_REG5 = PGSIZE * Index;
+        MEM_READ(Z502_REG5, &Z502_REG6);
+        if (Z502_REG6 != Z502_REG5)
+            printf("AN ERROR HAS OCCURRED: PAGE %ld READ %ld.\n",
+                   Index, Z502_REG6);
+    }
+    printf("PID= %ld  took %d faults with fault-around and %d without, for %d pages\n",
+           Z502_REG4, faults_around, faults_off, PAGES_2S);
+    TERMINATE_PROCESS(-2, &Z502_REG9);
+
+} // End test2s
+
 /**************************************************************************
 
  get_skewed_random_number   Is a homegrown deterministic random
@@ -63,7 +63,14 @@ void CreateLock(INT32 *, char *CallingRoutine);
 void CreateCondition(UINT32 *);
 void CreateSectorStruct(INT16, INT16, char **);
 void DequeueItemFromEventQueue(EVENT *, INT32 *);
-void DoMemoryDebug(INT16, INT16);
+void DoMemoryDebug(INT16, INT32);
+BOOL PageInTableRange(INT32);
+UINT32 *GetPageTableEntry(INT32);
+UINT32 *LookupTranslationCache(INT32);
+void FillTranslationCache(INT32, UINT32 *);
+void InvalidateTranslationCache(INT32);
+BOOL TLBAccess(INT32, UINT32);
+void TLBInvalidate(INT32);
 void DoSleep(INT32 millisecs);
 int GetLock(UINT32 RequestedMutex, char *CallingRoutine);
 void GetNextEventTime(INT32 *);
@@ -78,7 +85,7 @@ void HardwareTimer(INT32);
 void HardwareReadDisk(INT16, INT16, char *);
 void HardwareWriteDisk(INT16, INT16, char *);
 void HardwareInterrupt(void);
-void HardwareFault(INT16, INT16);
+void HardwareFault(INT16, INT32);
 void HardwareInternalPanic(INT32);
 void MemoryCommon(INT32, char *, BOOL);
 void PhysicalMemoryCommon(INT32, char *, BOOL);
@@ -95,13 +102,20 @@ void SoftwareTrap(void);
 void SuspendProcessExecution(Z502CONTEXT *Context);
 int WaitForCondition(UINT32 Condition, UINT32 Mutex, INT32 WaitTime,
                      char * Caller);
+void WaitForResume(int ourLocalID, char *CallingRoutine);
 void Z502Init();
+void AllocateMemory(void);
+INT32 GetGeometryParameter(char *Name, INT32 Default, INT32 Min, INT32 Max);
 
 //
 //      This is Physical Memory which is used in part 2 of the project. 
+//      It is mapped by Z502Init() once its size is known.
 //  
 
-char MEMORY[PHYS_MEM_PGS * PGSIZE ];
+char *MEMORY = NULL;
+INT16 Z502PhysMemPgs = DEFAULT_PHYS_MEM_PGS;
+INT16 Z502SlowMemPgs = DEFAULT_SLOW_MEM_PGS;
+INT32 Z502VirtualMemPgs = DEFAULT_VIRTUAL_MEM_PGS;
 
 //
 //      Declaration of Z502 Registers                 
@@ -109,8 +123,9 @@ char MEMORY[PHYS_MEM_PGS * PGSIZE ];
 //
 
 Z502CONTEXT *Z502_CURRENT_CONTEXT; // What Context is running
-UINT16 *Z502_PAGE_TBL_ADDR; // Location of the page table
-INT16 Z502_PAGE_TBL_LENGTH; // Length of the page table
+UINT32 *Z502_PAGE_TBL_ADDR; // Location of the page table
+UINT32 **Z502_PAGE_DIR_ADDR; // Location of the page directory, if any
+INT16 Z502_PAGE_TBL_LENGTH; // Length of the page table or directory
 INT16 Z502_MODE; // Kernel or user - hardware only
 
 long Z502_REG1;
@@ -139,6 +154,11 @@ EVENT EventQueue;
 INT32 NumberOfInterruptsStarted = 0;
 INT32 NumberOfInterruptsCompleted = 0;
 SECTOR sector_queue[MAX_NUMBER_OF_DISKS + 1];
+TRANSLATION_CACHE_ENTRY TranslationCache[TRANSLATION_CACHE_ENTRIES];
+void *TranslationCacheRoot = NULL; // The table the cache was filled from
+TLB_ENTRY TLB[TLB_SETS][TLB_WAYS];
+UINT32 TLBClock = 0;
+INT16 NextASID = 0;
 DISK_STATE disk_state[MAX_NUMBER_OF_DISKS + 1];
 TIMER_STATE timer_state;
 HARDWARE_STATS HardwareStats;
@@ -176,19 +196,26 @@ int NextMutexToAllocate = 0;
  + Illegal virtual address,
  + Page table doesn't exist,
  + Address is larger than page table,
- + Page table entry exists, but page is invalid.
+ + Page table entry exists, but page is invalid,
+ + Write to a page marked as protected.
  o The page exists in physical memory, so get the physical address.
  Be careful since it may wrap across frame boundaries.
  o Copy data to/from caller's location.
  o Set referenced/modified bit in page table.
- o Advance time and see if an interrupt has occurred.
+ o Advance time and see if an interrupt has occurred.  An access
+ touching the slow tier of memory takes longer.
  *****************************************************************/
 
 void MemoryCommon(INT32 VirtualAddress, char *data_ptr, BOOL read_or_write)
 {
-    INT16 VirtualPageNumber;
+    INT32 VirtualPageNumber;
+    UINT32 *pte;
+    UINT32 *next_pte = NULL;
+    INT32 max_pages;
+    INT32 tlb_cost;
+    INT32 memory_cost;
     INT32 phys_pg;
-    INT16 PhysicalAddress[4];
+    INT32 PhysicalAddress[4];
     INT32 page_offset;
     INT16 index;
     INT32 ptbl_bits;
@@ -204,29 +231,44 @@ void MemoryCommon(INT32 VirtualAddress, char *data_ptr, BOOL read_or_write)
         ReleaseLock(HardwareLock, Debug_Text);
         return;
     }
-    VirtualPageNumber = (INT16) (
-            (VirtualAddress >= 0) ? VirtualAddress / PGSIZE : -1);
+    VirtualPageNumber = (VirtualAddress >= 0) ? VirtualAddress / PGSIZE : -1;
+    max_pages = (Z502_PAGE_DIR_ADDR != NULL) ? VIRTUAL_MEM_PGS_MAX : VIRTUAL_MEM_PGS;
     page_offset = VirtualAddress % PGSIZE;
 
-    page_is_valid = FALSE;
+    // The OS may have installed another table without switching context.
+    if (TranslationCacheRoot != ((Z502_PAGE_DIR_ADDR != NULL)
+            ? (void *) Z502_PAGE_DIR_ADDR : (void *) Z502_PAGE_TBL_ADDR))
+        InvalidateTranslationCache(-1);
+
+    pte = LookupTranslationCache(VirtualPageNumber);
+    page_is_valid = (pte != NULL);
+    if (page_is_valid && read_or_write == SYSNUM_MEM_WRITE
+            && (*pte & PTBL_PROTECTED_BIT))
+        page_is_valid = FALSE;
 
     /*  Loop until the virtual page passes all the tests        */
 
     while (page_is_valid == FALSE)
     {
         invalidity = 0;
-        if (VirtualPageNumber >= VIRTUAL_MEM_PGS)
+        pte = NULL;
+        if (VirtualPageNumber >= max_pages)
             invalidity = 1;
         if (VirtualPageNumber < 0)
             invalidity = 2;
-        if (Z502_PAGE_TBL_ADDR == NULL)
+        if (Z502_PAGE_TBL_ADDR == NULL && Z502_PAGE_DIR_ADDR == NULL)
             invalidity = 3;
-        if (VirtualPageNumber >= Z502_PAGE_TBL_LENGTH)
+        if (invalidity == 0 && !PageInTableRange(VirtualPageNumber))
             invalidity = 4;
-        if ((invalidity == 0)
-                && (Z502_PAGE_TBL_ADDR[(UINT16) VirtualPageNumber]
-                & PTBL_VALID_BIT) == 0)
-            invalidity = 5;
+        if (invalidity == 0)
+        {
+            pte = GetPageTableEntry(VirtualPageNumber);
+            if (pte == NULL || (*pte & PTBL_VALID_BIT) == 0)
+                invalidity = 5;
+            else if (read_or_write == SYSNUM_MEM_WRITE
+                    && (*pte & PTBL_PROTECTED_BIT))
+                invalidity = 9;
+        }
 
         DoMemoryDebug(invalidity, VirtualPageNumber);
         if (invalidity > 0)
@@ -245,29 +287,43 @@ void MemoryCommon(INT32 VirtualAddress, char *data_ptr, BOOL read_or_write)
             GetLock(HardwareLock, Debug_Text);
         }
         else
+        {
             page_is_valid = TRUE;
+            FillTranslationCache(VirtualPageNumber, pte);
+        }
     } /* END of while         */
 
-    phys_pg = Z502_PAGE_TBL_ADDR[VirtualPageNumber] & PTBL_PHYS_PG_NO;
-    PhysicalAddress[0] = (INT16) (phys_pg * (INT32) PGSIZE + page_offset);
+    phys_pg = *pte & PTBL_PHYS_PG_NO;
+    PhysicalAddress[0] = phys_pg * (INT32) PGSIZE + page_offset;
     PhysicalAddress[1] = PhysicalAddress[0] + 1; /* first guess */
     PhysicalAddress[2] = PhysicalAddress[0] + 2; /* first guess */
     PhysicalAddress[3] = PhysicalAddress[0] + 3; /* first guess */
 
-    page_is_valid = FALSE;
     if (page_offset > PGSIZE - 4) /* long int wraps over page */
     {
+        next_pte = LookupTranslationCache(VirtualPageNumber + 1);
+        page_is_valid = (next_pte != NULL);
+        if (page_is_valid && read_or_write == SYSNUM_MEM_WRITE
+                && (*next_pte & PTBL_PROTECTED_BIT))
+            page_is_valid = FALSE;
         while (page_is_valid == FALSE)
         {
             invalidity = 0;
-            if (VirtualPageNumber + 1 >= VIRTUAL_MEM_PGS)
+            next_pte = NULL;
+            if (VirtualPageNumber + 1 >= max_pages)
                 invalidity = 6;
-            if (VirtualPageNumber + 1 >= Z502_PAGE_TBL_LENGTH)
+            else if (!PageInTableRange(VirtualPageNumber + 1))
                 invalidity = 7;
-            if ((Z502_PAGE_TBL_ADDR[(UINT16) VirtualPageNumber + 1]
-                    & PTBL_VALID_BIT) == 0)
-                invalidity = 8;
-            DoMemoryDebug(invalidity, (short) (VirtualPageNumber + 1));
+            else
+            {
+                next_pte = GetPageTableEntry(VirtualPageNumber + 1);
+                if (next_pte == NULL || (*next_pte & PTBL_VALID_BIT) == 0)
+                    invalidity = 8;
+                else if (read_or_write == SYSNUM_MEM_WRITE
+                        && (*next_pte & PTBL_PROTECTED_BIT))
+                    invalidity = 10;
+            }
+            DoMemoryDebug(invalidity, VirtualPageNumber + 1);
             if (invalidity > 0)
             {
                 if (Z502_CURRENT_CONTEXT->structure_id != CONTEXT_STRUCTURE_ID)
@@ -278,19 +334,22 @@ void MemoryCommon(INT32 VirtualAddress, char *data_ptr, BOOL read_or_write)
                 }
                 Z502_CURRENT_CONTEXT->fault_in_progress = TRUE;
 
-                HardwareFault(INVALID_MEMORY, (INT16) (VirtualPageNumber + 1));
+                HardwareFault(INVALID_MEMORY, VirtualPageNumber + 1);
             }
             else
+            {
                 page_is_valid = TRUE;
+                FillTranslationCache(VirtualPageNumber + 1, next_pte);
+            }
         } /* End of while         */
 
-        phys_pg = Z502_PAGE_TBL_ADDR[VirtualPageNumber + 1] & PTBL_PHYS_PG_NO;
+        phys_pg = *next_pte & PTBL_PHYS_PG_NO;
         for (index = PGSIZE - (INT16) page_offset; index <= 3; index++)
-            PhysicalAddress[index] = (INT16) ((phys_pg - 1) * (INT32) PGSIZE
+            PhysicalAddress[index] = (INT32) ((phys_pg - 1) * (INT32) PGSIZE
                 + page_offset + (INT32) index);
     } /* End of if page       */
 
-    if (phys_pg < 0 || phys_pg > PHYS_MEM_PGS - 1)
+    if (phys_pg < 0 || phys_pg > ALL_MEM_PGS - 1)
     {
         printf("The physical address is invalid in MemoryCommon\n");
         printf("Physical page = %d, Virtual Page = %d\n", phys_pg,
@@ -323,15 +382,234 @@ void MemoryCommon(INT32 VirtualAddress, char *data_ptr, BOOL read_or_write)
         ptbl_bits = PTBL_REFERENCED_BIT | PTBL_MODIFIED_BIT;
     }
 
-    Z502_PAGE_TBL_ADDR[VirtualPageNumber] |= ptbl_bits;
+    *pte |= ptbl_bits;
     if (page_offset > PGSIZE - 4)
-        Z502_PAGE_TBL_ADDR[VirtualPageNumber + 1] |= ptbl_bits;
+        *next_pte |= ptbl_bits;
+
+    // Every translation which misses the TLB pays for a page table walk.
+    tlb_cost = 0;
+    if (!TLBAccess(VirtualPageNumber, *pte))
+        tlb_cost += COST_OF_TLB_MISS;
+    if (page_offset > PGSIZE - 4
+            && !TLBAccess(VirtualPageNumber + 1, *next_pte))
+        tlb_cost += COST_OF_TLB_MISS;
+
+    memory_cost = COST_OF_MEMORY_ACCESS;
+    if ((*pte & PTBL_PHYS_PG_NO) >= PHYS_MEM_PGS || (page_offset > PGSIZE - 4
+            && (*next_pte & PTBL_PHYS_PG_NO) >= PHYS_MEM_PGS))
+    {
+        memory_cost = COST_OF_SLOW_MEMORY_ACCESS;
+        HardwareStats.slow_memory_accesses++;
+    }
+    else
+        HardwareStats.fast_memory_accesses++;
 
-    ChargeTimeAndCheckEvents(COST_OF_MEMORY_ACCESS);
+    ChargeTimeAndCheckEvents(memory_cost + tlb_cost);
 
     ReleaseLock(HardwareLock, Debug_Text);
 } // End of MemoryCommon
 
+/*****************************************************************
+ PageInTableRange
+
+ Check a virtual page against Z502_PAGE_TBL_LENGTH, which counts
+ directory slots when a page directory is installed, and page table
+ entries otherwise.
+
+ *****************************************************************/
+
+BOOL PageInTableRange(INT32 vpn)
+{
+    if (Z502_PAGE_DIR_ADDR != NULL)
+        return (vpn >> PTBL_LEAF_BITS) < Z502_PAGE_TBL_LENGTH;
+    return vpn < Z502_PAGE_TBL_LENGTH;
+} // End of PageInTableRange
+
+/*****************************************************************
+ GetPageTableEntry
+
+ Find the page table entry of a virtual page.  With a page directory
+ installed, Z502_PAGE_TBL_LENGTH is the length of the directory and
+ a directory slot may be NULL, meaning nothing in that region has
+ been mapped yet.  Otherwise the flat page table is used.
+ Returns NULL if there is no entry for the page.
+
+ *****************************************************************/
+
+UINT32 *GetPageTableEntry(INT32 vpn)
+{
+    UINT32 *leaf;
+
+    if (!PageInTableRange(vpn))
+        return NULL;
+    if (Z502_PAGE_DIR_ADDR != NULL)
+    {
+        leaf = Z502_PAGE_DIR_ADDR[vpn >> PTBL_LEAF_BITS];
+        if (leaf == NULL)
+            return NULL;
+        return &leaf[vpn & (PTBL_LEAF_ENTRIES - 1)];
+    }
+    if (Z502_PAGE_TBL_ADDR == NULL)
+        return NULL;
+    return &Z502_PAGE_TBL_ADDR[vpn];
+} // End of GetPageTableEntry
+
+/*****************************************************************
+ LookupTranslationCache
+
+ The translation cache is direct mapped and holds the location of
+ the page table entry of a virtual page, not its contents.  So when
+ the OS changes an entry, the cache still sees the new valid bit
+ and frame.  It must be invalidated only when the tables themselves
+ move: on a context switch, when another table is installed, or when
+ the OS frees a second level table (Z502InvalidateTranslation).
+ Returns the entry if it is cached and valid, otherwise NULL.
+
+ *****************************************************************/
+
+UINT32 *LookupTranslationCache(INT32 vpn)
+{
+    TRANSLATION_CACHE_ENTRY *entry;
+
+    if (vpn < 0)
+        return NULL;
+    entry = &TranslationCache[vpn & (TRANSLATION_CACHE_ENTRIES - 1)];
+    if (entry->pte != NULL && entry->vpn == vpn && (*entry->pte & PTBL_VALID_BIT))
+    {
+        HardwareStats.translation_cache_hits++;
+        return entry->pte;
+    }
+    HardwareStats.translation_cache_misses++;
+    return NULL;
+} // End of LookupTranslationCache
+
+/*****************************************************************
+ FillTranslationCache
+
+ Remember the page table entry of a virtual page which passed the
+ full page table walk.
+
+ *****************************************************************/
+
+void FillTranslationCache(INT32 vpn, UINT32 *pte)
+{
+    TRANSLATION_CACHE_ENTRY *entry;
+
+    entry = &TranslationCache[vpn & (TRANSLATION_CACHE_ENTRIES - 1)];
+    entry->vpn = vpn;
+    entry->pte = pte;
+    TranslationCacheRoot = (Z502_PAGE_DIR_ADDR != NULL)
+            ? (void *) Z502_PAGE_DIR_ADDR : (void *) Z502_PAGE_TBL_ADDR;
+} // End of FillTranslationCache
+
+/*****************************************************************
+ InvalidateTranslationCache
+
+ Forget a virtual page, or every page when vpn is -1.
+
+ *****************************************************************/
+
+void InvalidateTranslationCache(INT32 vpn)
+{
+    INT32 index;
+
+    if (vpn >= 0)
+    {
+        TranslationCache[vpn & (TRANSLATION_CACHE_ENTRIES - 1)].pte = NULL;
+        return;
+    }
+    for (index = 0; index < TRANSLATION_CACHE_ENTRIES; index++)
+        TranslationCache[index].pte = NULL;
+    TranslationCacheRoot = NULL;
+} // End of InvalidateTranslationCache
+
+/*****************************************************************
+ TLBAccess
+
+ Look a translation up in the modeled TLB of the current context and
+ load it if it's not there, replacing the least recently used entry
+ of its set.  An entry only counts as a hit if it still names the
+ frame the page table has, so an entry the OS forgot to invalidate
+ costs a miss but never a wrong translation.  A page table entry
+ with the large page bit is looked up by its block of LARGE_PAGE_PGS
+ pages and the first frame of its run.
+ Returns TRUE on a hit.
+
+ *****************************************************************/
+
+BOOL TLBAccess(INT32 vpn, UINT32 pte)
+{
+    TLB_ENTRY *set;
+    INT16 asid;
+    INT16 way;
+    INT16 victim = 0;
+    INT32 frame = pte & PTBL_PHYS_PG_NO;
+    BOOL large = (pte & PTBL_LARGE_PAGE_BIT) != 0;
+
+    if (large)
+    {
+        vpn /= LARGE_PAGE_PGS;
+        frame -= frame % LARGE_PAGE_PGS;
+    }
+    asid = (TLB_USE_ASID) ? Z502_CURRENT_CONTEXT->asid : 0;
+    set = TLB[vpn % TLB_SETS];
+    TLBClock++;
+    for (way = 0; way < TLB_WAYS; way++)
+    {
+        if (set[way].valid && set[way].asid == asid && set[way].vpn == vpn
+                && set[way].large == large)
+        {
+            if (set[way].frame == frame)
+            {
+                set[way].last_used = TLBClock;
+                HardwareStats.tlb_hits++;
+                if (large)
+                    HardwareStats.tlb_large_hits++;
+                Z502_CURRENT_CONTEXT->tlb_hits++;
+                return TRUE;
+            }
+            victim = way;
+            break;
+        }
+        if (!set[way].valid)
+            victim = way;
+        else if (set[victim].valid && set[way].last_used < set[victim].last_used)
+            victim = way;
+    }
+    set[victim].valid = TRUE;
+    set[victim].asid = asid;
+    set[victim].vpn = vpn;
+    set[victim].frame = frame;
+    set[victim].large = large;
+    set[victim].last_used = TLBClock;
+    HardwareStats.tlb_misses++;
+    Z502_CURRENT_CONTEXT->tlb_misses++;
+    return FALSE;
+} // End of TLBAccess
+
+/*****************************************************************
+ TLBInvalidate
+
+ Drop every TLB entry which maps a physical frame, whatever address
+ space it belongs to, including a large page entry whose run holds
+ it.  The OS does this when it takes the frame away from a page.
+ A frame of -1 empties the whole TLB.
+
+ *****************************************************************/
+
+void TLBInvalidate(INT32 frame)
+{
+    INT16 set;
+    INT16 way;
+
+    for (set = 0; set < TLB_SETS; set++)
+        for (way = 0; way < TLB_WAYS; way++)
+            if (frame == -1 || TLB[set][way].frame == frame
+                    || (TLB[set][way].large && frame >= TLB[set][way].frame
+                        && frame < TLB[set][way].frame + LARGE_PAGE_PGS))
+                TLB[set][way].valid = FALSE;
+} // End of TLBInvalidate
+
 /*****************************************************************
  DoMemoryDebug
 
@@ -339,7 +617,7 @@ void MemoryCommon(INT32 VirtualAddress, char *data_ptr, BOOL read_or_write)
 
  *****************************************************************/
 
-void DoMemoryDebug(INT16 invalidity, INT16 vpn)
+void DoMemoryDebug(INT16 invalidity, INT32 vpn)
 {
     if (DO_MEMORY_DEBUG == 0)
         return;
@@ -351,7 +629,8 @@ void DoMemoryDebug(INT16 invalidity, INT16 vpn)
     if (invalidity == 1)
     {
         printf("You asked for a virtual page, %d, greater than the\n", vpn);
-        printf("\t\tmaximum number of virtual pages, %d\n", VIRTUAL_MEM_PGS);
+        printf("\t\tmaximum number of virtual pages, %d\n",
+               (Z502_PAGE_DIR_ADDR != NULL) ? VIRTUAL_MEM_PGS_MAX : VIRTUAL_MEM_PGS);
     }
     if (invalidity == 2)
     {
@@ -383,7 +662,8 @@ void DoMemoryDebug(INT16 invalidity, INT16 vpn)
         printf("The address you asked for crosses onto a second page.\n");
         printf("\t\tThis second page took a fault.\n");
         printf("You asked for a virtual page, %d, greater than the\n", vpn);
-        printf("\t\tmaximum number of virtual pages, %d\n", VIRTUAL_MEM_PGS);
+        printf("\t\tmaximum number of virtual pages, %d\n",
+               (Z502_PAGE_DIR_ADDR != NULL) ? VIRTUAL_MEM_PGS_MAX : VIRTUAL_MEM_PGS);
     }
 
     if (invalidity == 7)
@@ -404,6 +684,18 @@ void DoMemoryDebug(INT16 invalidity, INT16 vpn)
         printf("\t\tYou must aim this virtual page at a physical frame\n");
         printf("\t\tand mark this page table slot as valid.\n");
     }
+    if (invalidity == 9)
+    {
+        printf("You wrote to virtual page %d, whose page table\n", vpn);
+        printf("\t\tslot is marked as protected.\n");
+    }
+    if (invalidity == 10)
+    {
+        printf("The address you asked for crosses onto a second page.\n");
+        printf("\t\tThis second page took a fault.\n");
+        printf("You wrote to virtual page %d, whose page table\n", vpn);
+        printf("\t\tslot is marked as protected.\n");
+    }
 } // End of DoMemoryDebug         
 
 /*****************************************************************
@@ -695,6 +987,38 @@ void MemoryMappedIO(INT32 address, INT32 *data, BOOL read_or_write)
             MemoryMappedDiskState.sector = -1;
             break;
         }
+        case Z502TLBInvalidate:
+        {
+            if (read_or_write == SYSNUM_MEM_WRITE)
+                TLBInvalidate(*data);
+            break;
+        }
+            /*  Reading a TLB counter returns the count of the current
+             *  context since it was last read, and clears it.  */
+        case Z502TLBHits:
+        {
+            if (read_or_write == SYSNUM_MEM_READ)
+            {
+                *data = Z502_CURRENT_CONTEXT->tlb_hits;
+                Z502_CURRENT_CONTEXT->tlb_hits = 0;
+            }
+            break;
+        }
+        case Z502TLBMisses:
+        {
+            if (read_or_write == SYSNUM_MEM_READ)
+            {
+                *data = Z502_CURRENT_CONTEXT->tlb_misses;
+                Z502_CURRENT_CONTEXT->tlb_misses = 0;
+            }
+            break;
+        }
+        case Z502InvalidateTranslation:
+        {
+            if (read_or_write == SYSNUM_MEM_WRITE)
+                InvalidateTranslationCache(*data);
+            break;
+        }
         case Z502DiskStatus:
         {
             if (MemoryMappedIODiskDevice == -1)
@@ -732,7 +1056,7 @@ void MemoryMappedIO(INT32 address, INT32 *data, BOOL read_or_write)
 void PhysicalMemoryCommon(INT32 PhysicalPageNumber, char *data_ptr,
                           BOOL read_or_write)
 {
-    INT16 PhysicalPageAddress;
+    INT32 PhysicalPageAddress;
     INT16 index;
     char Debug_Text[32];
 
@@ -747,7 +1071,7 @@ void PhysicalMemoryCommon(INT32 PhysicalPageNumber, char *data_ptr,
     }
     // If the user has asked for an illegal physical page, take a fault
     // then return with no modification to the user's buffer.
-    if (PhysicalPageNumber < 0 || PhysicalPageNumber > PHYS_MEM_PGS)
+    if (PhysicalPageNumber < 0 || PhysicalPageNumber > ALL_MEM_PGS - 1)
     {
         ReleaseLock(HardwareLock, Debug_Text);
         HardwareFault(INVALID_PHYSICAL_MEMORY, PhysicalPageNumber);
@@ -767,7 +1091,10 @@ void PhysicalMemoryCommon(INT32 PhysicalPageNumber, char *data_ptr,
             MEMORY[PhysicalPageAddress + index] = data_ptr[index];
     }
 
-    ChargeTimeAndCheckEvents(COST_OF_MEMORY_ACCESS);
+    if (PhysicalPageNumber >= PHYS_MEM_PGS)
+        ChargeTimeAndCheckEvents(COST_OF_SLOW_MEMORY_ACCESS);
+    else
+        ChargeTimeAndCheckEvents(COST_OF_MEMORY_ACCESS);
     ReleaseLock(HardwareLock, Debug_Text);
 } // End of PhysicalMemoryCommon
 
@@ -834,7 +1161,7 @@ void HardwareReadDisk(INT16 disk_id, INT16 sector, char *buffer_ptr)
         disk_id = 1; /* To aim at legal vector  */
         error_found = ERR_BAD_PARAM;
     }
-    if (sector < 0 || sector >= NUM_LOGICAL_SECTORS)
+    if (sector < 0 || sector >= NUM_DISK_SECTORS)
         error_found = ERR_BAD_PARAM;
 
     if (error_found == 0)
@@ -932,7 +1259,7 @@ void HardwareWriteDisk(INT16 disk_id, INT16 sector, char *buffer_ptr)
         disk_id = 1; /* To aim at legal vector  */
         error_found = ERR_BAD_PARAM;
     }
-    if (sector < 0 || sector >= NUM_LOGICAL_SECTORS)
+    if (sector < 0 || sector >= NUM_DISK_SECTORS)
         error_found = ERR_BAD_PARAM;
 
     if (disk_state[disk_id].disk_in_use == TRUE)
@@ -1234,10 +1561,20 @@ void Z502MakeContext(void **ReturningContextPointer, void *starting_address,
     our_ptr->structure_id = CONTEXT_STRUCTURE_ID;
     our_ptr->entry = (void *) starting_address;
     our_ptr->page_table_ptr = NULL;
+    our_ptr->page_dir_ptr = NULL;
     our_ptr->page_table_len = 0;
     our_ptr->pc = 0;
     our_ptr->program_mode = user_or_kernel;
     our_ptr->fault_in_progress = FALSE;
+    // When the address space ids run out, start over with an empty TLB.
+    if (NextASID == TLB_NUMBER_OF_ASIDS)
+    {
+        TLBInvalidate(-1);
+        NextASID = 0;
+    }
+    our_ptr->asid = NextASID++;
+    our_ptr->tlb_hits = 0;
+    our_ptr->tlb_misses = 0;
     *ReturningContextPointer = (void *) our_ptr;
 
     // Attach the Context to a thread
@@ -1391,6 +1728,7 @@ void Z502SwitchContext(BOOL kill_or_save, void **IncomingContextPointer)
             curr_ptr->reg8 = Z502_REG8;
             curr_ptr->reg9 = Z502_REG9;
             curr_ptr->page_table_ptr = Z502_PAGE_TBL_ADDR;
+            curr_ptr->page_dir_ptr = Z502_PAGE_DIR_ADDR;
             curr_ptr->page_table_len = Z502_PAGE_TBL_LENGTH;
         }
     } // End of current context not null
@@ -1407,7 +1745,11 @@ void Z502SwitchContext(BOOL kill_or_save, void **IncomingContextPointer)
     }
 
     Z502_CURRENT_CONTEXT = curr_ptr;
+    InvalidateTranslationCache(-1);
+    if (!TLB_USE_ASID)
+        TLBInvalidate(-1);
     Z502_PAGE_TBL_ADDR = curr_ptr->page_table_ptr;
+    Z502_PAGE_DIR_ADDR = curr_ptr->page_dir_ptr;
     Z502_PAGE_TBL_LENGTH = curr_ptr->page_table_len;
     Z502_MODE = curr_ptr->program_mode;
     Z502_REG1 = curr_ptr->reg1;
@@ -1489,7 +1831,6 @@ void ChargeTimeAndCheckEvents(INT32 time_to_charge)
 void HardwareInterrupt(void)
 {
     INT32 time_of_event;
-    INT32 index;
     INT16 event_type;
     INT16 event_error;
     INT32 local_error;
@@ -1540,24 +1881,12 @@ void HardwareInterrupt(void)
                 HardwareInternalPanic(ERR_Z502_INTERNAL_BUG);
             }
 
-            //  NOTE:  Here when we take a disk interrupt, we clear the busy of ALL
-            //  disks because we assume that the user will handle all of them with
-            //  the interrupt that's about to be done.
-            for (index = DISK_INTERRUPT;
-                    index <= DISK_INTERRUPT + MAX_NUMBER_OF_DISKS - 1;
-                    index++)
-            {
-                if ((STAT_VECTOR[SV_ACTIVE ][index] != 0)
-                        && (STAT_VECTOR[SV_TID ][index] == GetMyTid()))
-                {
-                    // Bugfix 08/2012 - disk_state contains MAX_NUMBER_OF_DISKS elements
-                    // We were spraying some unknown memory locations
-                    disk_state[index - DISK_INTERRUPT ].disk_in_use = FALSE;
-                    // printf("3. Setting %d FALSE\n", index );
-                }
-            }
-            //  We MAYBE should be clearing all these as well - and not just the current one.
-
+            //  NOTE:  Only the disk that caused this event becomes free.  Each
+            //  event is delivered to the interrupt handler on its own, so a
+            //  vector still marked active belongs to a disk whose interrupt is
+            //  on its way - freeing that disk here would let the OS start a
+            //  second request on it and turn its pending event into a false
+            //  interrupt.
             disk_state[event_type - DISK_INTERRUPT + 1].disk_in_use = FALSE;
             // printf("3. Setting %d FALSE\n", event_type );
             disk_state[event_type - DISK_INTERRUPT + 1].event_ptr = NULL;
@@ -1633,12 +1962,12 @@ void HardwareInterrupt(void)
 
  *****************************************************************/
 
-void HardwareFault(INT16 fault_type, INT16 argument)
+void HardwareFault(INT16 fault_type, INT32 argument)
 {
     void (*fault_handler)(void);
 
     STAT_VECTOR[SV_ACTIVE ][fault_type] = 1;
-    STAT_VECTOR[SV_VALUE ][fault_type] = (INT16) argument;
+    STAT_VECTOR[SV_VALUE ][fault_type] = argument;
     STAT_VECTOR[SV_TID ][fault_type] = GetMyTid();
     Z502_MODE = KERNEL_MODE;
     HardwareStats.number_faults++;
@@ -1988,10 +2317,11 @@ void GetNextEventTime(INT32 *time_of_next_event)
 void PrintHardwareStats(void)
 {
     INT32 i, temp;
+    INT32 busy = 0;
     double util; /* This is in range 0 - 1       */
 
     printf("Hardware Statistics during the Simulation\n");
-    for (i = 0; i < MAX_NUMBER_OF_DISKS; i++)
+    for (i = 0; i <= MAX_NUMBER_OF_DISKS; i++)
     {
         temp = HardwareStats.disk_reads[i] + HardwareStats.disk_writes[i];
         if (temp > 0)
@@ -2001,14 +2331,30 @@ void PrintHardwareStats(void)
             util = (double) HardwareStats.time_disk_busy[i]
                     / (double) CurrentSimulationTime;
             printf("Disk Utilization = %6.3f\n", util);
+            busy += HardwareStats.time_disk_busy[i];
         }
     }
+    if (busy > 0)
+        printf("Disk Busy Time = %d\n", busy);
     if (HardwareStats.number_faults > 0)
         printf("Faults = %5d:  ", HardwareStats.number_faults);
     if (HardwareStats.context_switches > 0)
         printf("Context Switches = %5d:  ", HardwareStats.context_switches);
     printf("CALLS = %5d:  ", HardwareStats.number_charge_times);
     printf("Masks = %5d\n", HardwareStats.number_mask_set_seen);
+    if (HardwareStats.translation_cache_hits + HardwareStats.translation_cache_misses > 0)
+        printf("Translation Cache Hits = %5d:  Misses = %5d\n",
+               HardwareStats.translation_cache_hits,
+               HardwareStats.translation_cache_misses);
+    if (HardwareStats.tlb_hits + HardwareStats.tlb_misses > 0)
+        printf("TLB Hits = %5d:  Misses = %5d\n",
+               HardwareStats.tlb_hits, HardwareStats.tlb_misses);
+    if (HardwareStats.tlb_large_hits > 0)
+        printf("TLB Hits on Large Pages = %5d\n", HardwareStats.tlb_large_hits);
+    if (HardwareStats.slow_memory_accesses > 0)
+        printf("Memory Accesses Fast = %5d:  Slow = %5d\n",
+               HardwareStats.fast_memory_accesses,
+               HardwareStats.slow_memory_accesses);
 
 } // End of PrintHardwareStats   
 
@@ -2258,6 +2604,7 @@ void Z502CreateUserThread(void *ThreadStartAddress)
                                                      &ourLocalID);
     ThreadTable[ourLocalID].Context = (Z502CONTEXT *) - 1;
     ThreadTable[ourLocalID].CurrentState = CREATED;
+    ThreadTable[ourLocalID].ResumePending = FALSE;
     PrintThreadTable("Z502CreateUserThread\n");
     ReleaseLock(ThreadTableLock, "Z502CreateUserThread");
 } // End of Z502CreateUserThread
@@ -2326,9 +2673,7 @@ void *Z502PrepareProcessForExecution()
     while (ThreadTable[ourLocalID].CurrentState == SUSPENDED_WAITING_FOR_CONTEXT)
     {
         //ReleaseLock( ThreadTableLock, "Z502PrepareProcessForExecution" );
-        WaitForCondition(ThreadTable[ourLocalID].Condition,
-                         ThreadTable[ourLocalID].Mutex, 30,
-                         "Z502PrepareProcessForExecution");
+        WaitForResume(ourLocalID, "Z502PrepareProcessForExecution");
     }
     // Now "magically", when we are awakened, we have a Context associated
     // with us and our state should be  ACTIVE
@@ -2352,16 +2697,24 @@ void AssociateContextWithProcess(Z502CONTEXT *Context)
 {
     int ourLocalID = -1;
     int i;
+    int attempts;
     //GetLock( ThreadTableLock, "AssociateContextWithProcess" );
     PrintThreadTable("Entering -> AssociateContextWithProcess\n");
-    // Find a thread that needs a context
-    for (i = 0; i < MAX_NUMBER_OF_USER_THREADS; i++)
+    // Find a thread that needs a context.  Right after start up the
+    // threads may not all have reached Z502PrepareProcessForExecution,
+    // so give them a moment before deciding that none is left.
+    for (attempts = 0; ourLocalID == -1 && attempts < 100; attempts++)
     {
-        if (ThreadTable[i].CurrentState == SUSPENDED_WAITING_FOR_CONTEXT)
+        for (i = 0; i < MAX_NUMBER_OF_USER_THREADS; i++)
         {
-            ourLocalID = i;
-            break;
+            if (ThreadTable[i].CurrentState == SUSPENDED_WAITING_FOR_CONTEXT)
+            {
+                ourLocalID = i;
+                break;
+            }
         }
+        if (ourLocalID == -1)
+            DoSleep(10);
     }
     if (ourLocalID == -1)
     {
@@ -2398,10 +2751,22 @@ void ResumeProcessExecution(Z502CONTEXT *Context)
         printf("Error in ResumeProcessExecuton\n");
         HardwareInternalPanic(ERR_Z502_INTERNAL_BUG);
     }
-    ThreadTable[ourLocalID].CurrentState = ACTIVE;
     PrintThreadTable("ResumeProcessExecution\n");
+#if defined LINUX || defined MAC
+    // The flag and the signal are published under the thread's own mutex,
+    // which the target only gives up inside pthread_cond_wait.  A target
+    // that has not reached its wait yet finds the flag already set rather
+    // than missing the signal and sleeping forever.
+    pthread_mutex_lock(&(LocalMutex[ThreadTable[ourLocalID].Mutex]));
+    ThreadTable[ourLocalID].CurrentState = ACTIVE;
+    ThreadTable[ourLocalID].ResumePending = TRUE;
+    pthread_cond_signal(&(LocalCondition[ThreadTable[ourLocalID].Condition]));
+    pthread_mutex_unlock(&(LocalMutex[ThreadTable[ourLocalID].Mutex]));
+#else
+    ThreadTable[ourLocalID].CurrentState = ACTIVE;
     SignalCondition(ThreadTable[ourLocalID].Condition,
                     "ResumeProcessExecution");
+#endif
     ReleaseLock(ThreadTableLock, "ResumeProcessExecution");
 } // End of ResumeProcessExecution
 
@@ -2449,10 +2814,34 @@ void SuspendProcessExecution(Z502CONTEXT *Context)
     }
     PrintThreadTable("SuspendProcessExecution\n");
     //ReleaseLock( ThreadTableLock, "SuspendProcessExecution" );
-    WaitForCondition(ThreadTable[ourLocalID].Condition,
-                     ThreadTable[ourLocalID].Mutex, 30, "SuspendProcessExecution");
+    WaitForResume(ourLocalID, "SuspendProcessExecution");
 }
 
+/**************************************************************************
+ WaitForResume
+ Block the calling thread until ResumeProcessExecution has been called
+ for it.  On LINUX and MAC the wait is guarded by the ResumePending flag
+ so that a resume arriving before the thread gets here is not lost.
+ Windows events stay signalled until waited on, so there the plain
+ condition wait is enough.
+ **************************************************************************/
+void WaitForResume(int ourLocalID, char *CallingRoutine)
+{
+#if defined LINUX || defined MAC
+    // The mutex may still be held by this thread from an earlier wait;
+    // the error checking mutex then just reports EDEADLK.
+    pthread_mutex_lock(&(LocalMutex[ThreadTable[ourLocalID].Mutex]));
+    while (!ThreadTable[ourLocalID].ResumePending)
+        pthread_cond_wait(&(LocalCondition[ThreadTable[ourLocalID].Condition]),
+                          &(LocalMutex[ThreadTable[ourLocalID].Mutex]));
+    ThreadTable[ourLocalID].ResumePending = FALSE;
+    pthread_mutex_unlock(&(LocalMutex[ThreadTable[ourLocalID].Mutex]));
+#else
+    WaitForCondition(ThreadTable[ourLocalID].Condition,
+                     ThreadTable[ourLocalID].Mutex, 30, CallingRoutine);
+#endif
+} // End of WaitForResume
+
 /**************************************************************************
  CreateAThread
  There are Linux and Windows dependencies here.  Set up the threads
@@ -3305,6 +3694,49 @@ void GoToExit(int Value)
     exit(Value);
 } // End of GoToExit
 
+/*****************************************************************
+ GetGeometryParameter()
+
+ The size of a memory, as given in the environment when the
+ simulator starts.  A value out of range stops the simulation.
+ *****************************************************************/
+
+INT32 GetGeometryParameter(char *Name, INT32 Default, INT32 Min, INT32 Max)
+{
+    char *Value = getenv(Name);
+    char *End;
+    long Result;
+
+    if (Value == NULL || *Value == '\0')
+        return Default;
+    Result = strtol(Value, &End, 10);
+    if (*End != '\0' || Result < Min || Result > Max)
+    {
+        printf("%s=%s is not in the range %d - %d\n", Name, Value, Min, Max);
+        GoToExit(0);
+    }
+    return (INT32) Result;
+} // End of GetGeometryParameter
+
+/*****************************************************************
+ AllocateMemory()
+
+ Allocate the physical memory, once its size is known.
+ *****************************************************************/
+
+void AllocateMemory(void)
+{
+    MEMORY = (char *) malloc((size_t) ALL_MEM_PGS * PGSIZE);
+    if (MEMORY == NULL)
+    {
+        printf("We were unable to allocate %d pages of physical memory\n",
+               ALL_MEM_PGS);
+        GoToExit(0);
+    }
+    printf("Physical memory is %d fast and %d slow frames of %d bytes, %d virtual pages\n\n",
+           PHYS_MEM_PGS, SLOW_MEM_PGS, PGSIZE, VIRTUAL_MEM_PGS);
+} // End of AllocateMemory
+
 /*****************************************************************
  Z502Init()
 
@@ -3316,6 +3748,7 @@ void GoToExit(int Value)
 void Z502Init()
 {
     INT16 i;
+    INT32 j;
 
     if (Z502Initialized == FALSE)
     {
@@ -3331,7 +3764,7 @@ void Z502Init()
         CreateLock(&HardwareLock, "Z502Init");
         CreateLock(&ThreadTableLock, "Z502Init");
         CreateCondition(&InterruptCondition);
-        for (i = 1; i < MAX_NUMBER_OF_DISKS; i++)
+        for (i = 1; i <= MAX_NUMBER_OF_DISKS; i++)
         {
             sector_queue[i].queue = NULL;
             disk_state[i].last_sector = 0;
@@ -3354,8 +3787,15 @@ void Z502Init()
         for (i = 0; i < MEMORY_INTERLOCK_SIZE; i++)
             InterlockRecord[i] = -1;
 
-        for (i = 0; i < sizeof (MEMORY); i++)
-            MEMORY[i] = i % 256;
+        Z502PhysMemPgs = (INT16) GetGeometryParameter("Z502_PHYS_MEM_PGS",
+                DEFAULT_PHYS_MEM_PGS, 1, MAX_ALL_MEM_PGS);
+        Z502SlowMemPgs = (INT16) GetGeometryParameter("Z502_SLOW_MEM_PGS",
+                DEFAULT_SLOW_MEM_PGS, 0, MAX_ALL_MEM_PGS - Z502PhysMemPgs);
+        Z502VirtualMemPgs = GetGeometryParameter("Z502_VIRTUAL_MEM_PGS",
+                DEFAULT_VIRTUAL_MEM_PGS, 1, VIRTUAL_MEM_PGS_MAX);
+        AllocateMemory();
+        for (j = 0; j < ALL_MEM_PGS * PGSIZE; j++)
+            MEMORY[j] = j % 256;
 
         timer_state.timer_in_use = FALSE;
         timer_state.event_ptr = NULL;
@@ -10,6 +10,7 @@
 #define  Z502_H
 
 #define         COST_OF_MEMORY_ACCESS           1L
+#define         COST_OF_SLOW_MEMORY_ACCESS      4L
 #define         COST_OF_MEMORY_MAPPED_IO        1L
 #define         COST_OF_DISK_ACCESS             8L
 #define         COST_OF_DELAY                   2L
@@ -21,6 +22,7 @@
 #define         COST_OF_SOFTWARE_TRAP           5L
 #define         COST_OF_CPU_INSTRUCTION         1L
 #define         COST_OF_CALL                    2L
+#define         COST_OF_TLB_MISS                2L
 
 #ifndef NULL
 #define         NULL                            0
@@ -32,6 +34,22 @@
 
 #define         EVENT_RING_BUFFER_SIZE          16
 
+/*  The translation cache remembers where the page table entries of
+    recently used virtual pages are.  Must be a power of two.       */
+
+#define         TRANSLATION_CACHE_ENTRIES       64
+
+/*  The modeled TLB.  Its entries are split into sets of TLB_WAYS entries,
+    replaced least recently used.  With TLB_USE_ASID, entries are tagged
+    with the address space of their context and survive context switches,
+    otherwise the TLB is flushed on every switch.                    */
+
+#define         TLB_ENTRIES                     16
+#define         TLB_WAYS                        4
+#define         TLB_SETS                        (TLB_ENTRIES / TLB_WAYS)
+#define         TLB_NUMBER_OF_ASIDS             256
+#define         TLB_USE_ASID                    TRUE
+
 /*  STAT_VECTOR is a two dimensional array.  The first
     dimension can take on values shown here.  The
     second dimension holds the error or device type.     */
@@ -65,14 +83,37 @@ typedef struct
 typedef struct
 {
     INT32 context_switches;
-    INT32 disk_reads[MAX_NUMBER_OF_DISKS];
-    INT32 disk_writes[MAX_NUMBER_OF_DISKS];
-    INT32 time_disk_busy[MAX_NUMBER_OF_DISKS];
+    INT32 disk_reads[MAX_NUMBER_OF_DISKS + 1];
+    INT32 disk_writes[MAX_NUMBER_OF_DISKS + 1];
+    INT32 time_disk_busy[MAX_NUMBER_OF_DISKS + 1];
     INT32 number_charge_times;
     INT32 number_mask_set_seen;
     INT32 number_faults;
+    INT32 translation_cache_hits;
+    INT32 translation_cache_misses;
+    INT32 tlb_hits;
+    INT32 tlb_misses;
+    INT32 tlb_large_hits;
+    INT32 fast_memory_accesses;
+    INT32 slow_memory_accesses;
 } HARDWARE_STATS;
 
+typedef struct
+{
+    INT32 vpn;
+    UINT32 *pte;
+} TRANSLATION_CACHE_ENTRY;
+
+typedef struct
+{
+    BOOL valid;
+    INT16 asid;
+    INT32 vpn;
+    INT32 frame;
+    BOOL large;
+    UINT32 last_used;
+} TLB_ENTRY;
+
 typedef struct
 {
     INT32 *queue;
@@ -86,7 +127,8 @@ typedef struct
 {
     unsigned char structure_id;
     void *entry;
-    UINT16 *page_table_ptr;
+    UINT32 *page_table_ptr;
+    UINT32 **page_dir_ptr;
     INT16 page_table_len;
     INT16 pc;
     INT32 call_type;
@@ -95,6 +137,9 @@ typedef struct
     INT16 program_mode;
     INT16 mode_at_first_interrupt;
     BOOL fault_in_progress;
+    INT16 asid;
+    INT32 tlb_hits;
+    INT32 tlb_misses;
 } Z502CONTEXT;
 
 // We create a thread for every potential process a user might create.
@@ -108,6 +153,7 @@ typedef struct
     Z502CONTEXT *Context;
     UINT32 Condition;
     UINT32 Mutex;
+    BOOL ResumePending; // Set when resumed, cleared by the woken thread
 } THREAD_INFO;
 
 // These are the states defined for a thread and stored in CurrentState
@@ -18,6 +18,11 @@
 #define MAX_NUMBER_OF_PROCESSE_NAME       32
 #define MAX_NUMBER_OF_MESSAGES            10
 #define MAX_LENGTH_OF_LEGAL_MESSAGE       64
+#define MAX_NUMBER_OF_SHARED_AREAS        8
+#define MAX_LENGTH_OF_AREA_TAG            32
+#define MAX_NUMBER_OF_ADVICE_RANGES       8
+#define MAX_NUMBER_OF_DISK_MAPS           4
+#define MAX_NUMBER_OF_USERFAULT_RANGES    4
 
 // Used for scheduler printer setup.
 #define ACTION_NAME_ALLDONE    "AllDone"
@@ -31,6 +36,8 @@
 #define ACTION_NAME_WRITE      "Write"
 #define ACTION_NAME_READ       "Read"
 #define ACTION_NAME_INTERRUPT  "Interupt"
+#define ACTION_NAME_SWAP_OUT   "SwapOut"
+#define ACTION_NAME_SWAP_IN    "SwapIn"
 
 #define NORMAL_INFO 1
 #define FINAL_INFO 0
@@ -52,12 +59,34 @@
 // Default priority for the initial process.
 #define DEFAULT_PRIORITY 8
 
+// Priorities run from 0, the most important, to MAX_PRIORITY.
+#define MAX_PRIORITY 100
+
+// Default size of the aligned block of pages mapped around a fault, 1 turns fault-around off.
+// SET_PAGING_PARAMETER sets another one, see os_set_paging_parameter().
+#define DEFAULT_FAULT_AROUND 4
+
+// Default size of the virtual address space of a process, in pages. The page
+// directory can cover up to VIRTUAL_MEM_PGS_MAX.
+#define DEFAULT_VIRTUAL_PAGES VIRTUAL_MEM_PGS
+
+// Default hard limit on the frames a process may hold, 0 means no limit.
+// SET_PAGING_PARAMETER sets another one, see os_set_paging_parameter().
+#define DEFAULT_FRAME_QUOTA 0
+
+// Whether the faults of a process may map a large page. Blocks of resident
+// pages are collapsed into large pages either way.
+#define DEFAULT_LARGE_PAGES TRUE
+
 // Lock names.
 #define COMMON_DATA_LOCK  ((MEMORY_INTERLOCK_BASE) + 1)
 #define TIMER_QUEUE_LOCK  ((MEMORY_INTERLOCK_BASE) + 2)
 #define READY_QUEUE_LOCK  ((MEMORY_INTERLOCK_BASE) + 3)
 #define SUSPEND_QUEUE_LOCK  ((MEMORY_INTERLOCK_BASE) + 4)
 #define PRINT_LOCK  ((MEMORY_INTERLOCK_BASE) + 5)
+// Held from choosing a disk until the request and its waiter are recorded,
+// so the interrupt of the request cannot be handled in between.
+#define DISK_REGISTER_LOCK  ((MEMORY_INTERLOCK_BASE) + 6)
 
 // Used for lock operations.
 #define DO_LOCK                                 1
@@ -69,5 +98,7 @@
 #define WRITE_TWO 1
 #define READ_ONE 2
 #define READ_TWO 3
+// Not a disk operation: the process waits for a user-level fault handler.
+#define WAIT_USERFAULT 4
 
 #endif	/* COMMON_H */
@@ -15,6 +15,7 @@
 #include "os_utils.h"
 #include "proc_mgmt.h"
 #include "data_struct.h"
+#include "storage_mgmt.h"
 
 // Used to save global configuration argument.
 ConfigArgEntry *ConfigArgument;
@@ -36,6 +37,19 @@ ConfigArgEntry config_arg_table[] = {
     { "test2d", test2d, Limited, Limited, None},
     { "test2e", test2e, Limited, Limited, Limited},
     { "test2f", test2f, Limited, None, Limited},
+    { "test2g", test2g, Limited, None, Limited},
+    { "test2h", test2h, Limited, None, Limited},
+    { "test2i", test2i, Limited, None, Limited},
+    { "test2j", test2j, Limited, None, Limited},
+    { "test2k", test2k, Limited, None, Limited},
+    { "test2l", test2l, Limited, None, Limited},
+    { "test2m", test2m, Limited, None, Limited},
+    { "test2n", test2n, Limited, None, Limited},
+    { "test2o", test2o, Limited, None, Limited},
+    { "test2p", test2p, Limited, None, Limited},
+    { "test2q", test2q, Limited, None, Limited},
+    { "test2r", test2r, Limited, None, Limited},
+    { "test2s", test2s, Limited, None, Limited},
 };
 
 // Description: Get appropriate configuration argument entry according to the input argument.
@@ -72,6 +86,11 @@ void wait_for_time(void)
 
 void idle_and_wait(void)
 {
+    clean_swap_log();
+    merge_identical_frames();
+    balance_memory_tiers();
+    collapse_large_pages();
+    refill_zero_pool();
     CALL(Z502Idle());
     // Don't call Z502Idle() too fast, make sure the event
     // is triggered within ten times of Z502Idle() invocations.
@@ -165,6 +184,7 @@ void switch_context(BOOL kill_or_save, void **incoming_context)
 void shut_down(void)
 {
     printf("All processes will be terminated!\n");
+    print_storage_stats();
     CALL(Z502Halt());
 }
 
@@ -9,15 +9,20 @@
 #include "syscalls.h"
 #include "proc_mgmt.h"
 #include "data_struct.h"
+#include "storage_mgmt.h"
 
 PCB *RootPCB; // Indicate Initial Process.
 PCB *CurrentPCB; // Indicate current Process.
 Queue *TimerQueue; // Indicate the queue which contains sleeping processes.
 Queue *ReadyQueue; // Indicate the queue which contains processes who are ready to be run.
 Queue *SuspendQueue; // Indicate the queue which contains suspended processes.
+Queue *SwappedQueue; // Indicate the queue which contains processes swapped out by load control.
+Queue *ZombieQueue; // Indicate the queue which contains terminated processes whose frames are still being written back.
 
 extern Queue *DiskQueue;
 extern Queue *FrameQueue;
+extern Queue *ZeroFrameQueue;
+extern Queue *FastFrameQueue;
 
 /***For type safe, always use pointer to function as the callback argument!***/
 FuncMatch fp_match; // Used as callback when find matching items.
@@ -46,10 +51,32 @@ int match_pid(const void *data1, const void *pid)
     return ((const PCB *) data1)->pid == (INT32) pid;
 }
 
-int match_disk_id(const void *data1, const void *disk_id)
+// Description: Check if the process is waiting for a request it has already
+// started on the disk to complete.
+// Parameter @data1: The process to be checked.
+// Parameter @disk_id: The disk id to be matched.
+// Return: 1 indicates matching.  0 indicates does not match.
+
+int match_disk_started(const void *data1, const void *disk_id)
 {
     assert(data1 && disk_id);
-    return ((const PCB *) data1)->disk_id == (INT16) disk_id;
+    const PCB *pcb = (const PCB *) data1;
+    return pcb->disk_id == (INT16) (long) disk_id
+            && pcb->operation != WRITE_ONE && pcb->operation != READ_ONE;
+}
+
+// Description: Check if the process is waiting for the disk to become free
+// so that its request can be started.
+// Parameter @data1: The process to be checked.
+// Parameter @disk_id: The disk id to be matched.
+// Return: 1 indicates matching.  0 indicates does not match.
+
+int match_disk_pending(const void *data1, const void *disk_id)
+{
+    assert(data1 && disk_id);
+    const PCB *pcb = (const PCB *) data1;
+    return pcb->disk_id == (INT16) (long) disk_id
+            && (pcb->operation == WRITE_ONE || pcb->operation == READ_ONE);
 }
 
 
@@ -112,10 +139,18 @@ int init_queues()
         return 0;
     if ((SuspendQueue = queue_create()) == NULL)
         return 0;
+    if ((SwappedQueue = queue_create()) == NULL)
+        return 0;
+    if ((ZombieQueue = queue_create()) == NULL)
+        return 0;
     if ((DiskQueue = queue_create()) == NULL)
         return 0;
     if ((FrameQueue = queue_create()) == NULL)
         return 0;
+    if ((ZeroFrameQueue = queue_create()) == NULL)
+        return 0;
+    if ((FastFrameQueue = queue_create()) == NULL)
+        return 0;
     return 1;
 }
 
@@ -156,6 +191,18 @@ int remove_from_process_table(PCB *pcb_to_remove)
         return 0;
 }
 
+// Description: Park a terminated process whose frames are still being
+// written back. It stays in the global process table, so its pid is not
+// reused, until reap_zombies() removes it.
+// Parameter @pcb: The terminated process.
+// Return: On success, 1 is returned.  On error, 0 is returned.
+
+int add_to_zombie_queue(PCB *pcb)
+{
+    pcb->zombie = TRUE;
+    return queue_enqueue(ZombieQueue, pcb);
+}
+
 // Description: Print scheduling information by using scheduler printer.
 // Parameter @action_mode: The string indicates the action mode.
 // Parameter @target_pcb: The process on which the scheduler action is being performed.
@@ -207,6 +254,15 @@ void print_scheduling_info(char *action_mode, PCB *target_pcb, int info_type)
                          SP_setup(SP_SUSPENDED_MODE, ((PCB *) element->data)->pid));
                 }
             }
+            if (!queue_is_empty(SwappedQueue))
+            {
+                for (element = queue_head(SwappedQueue); element; element =
+                        queue_next(element))
+                {
+                    CALL(
+                         SP_setup(SP_SWAPPED_MODE, ((PCB *) element->data)->pid));
+                }
+            }
         }
         else if (info_type == FINAL_INFO)
         {
@@ -290,6 +346,15 @@ void print_scheduling_info(char *action_mode, PCB *target_pcb, int info_type)
                              SP_setup(SP_SUSPENDED_MODE, ((PCB *) element->data)->pid));
                     }
                 }
+                if (!queue_is_empty(SwappedQueue))
+                {
+                    for (element = queue_head(SwappedQueue); element; element =
+                            queue_next(element))
+                    {
+                        CALL(
+                             SP_setup(SP_SWAPPED_MODE, ((PCB *) element->data)->pid));
+                    }
+                }
             }
             else if (info_type == FINAL_INFO)
             {
@@ -604,7 +669,7 @@ int check_length_of_process_name(const char *name)
 
 int validate_priority_range(INT32 priority)
 {
-    if (priority < 0 || priority > 100)
+    if (priority < 0 || priority > MAX_PRIORITY)
         return 0;
 
     else
@@ -690,10 +755,17 @@ PCB *create_pcb(const char *name, void *start_point, INT32 priority,
         pcb->priority = priority;
         pcb->suspend = FALSE;
         pcb->need_message = FALSE;
+        pcb->zombie = FALSE;
+        pcb->in_disk_io = FALSE;
         pcb->entry_point = start_point;
         pcb->disk_id = pid / 2 + 1;
         pcb->operation = -1;
+        pcb->fault_around = DEFAULT_FAULT_AROUND;
+        pcb->virtual_pages = DEFAULT_VIRTUAL_PAGES;
+        pcb->frame_quota = DEFAULT_FRAME_QUOTA;
+        pcb->large_pages = DEFAULT_LARGE_PAGES;
         strncpy(pcb->process_name, name, strlen(name) + 1);
+        reset_paging_state(pid);
 
         result = add_to_process_table(pcb);
         if (!result)
@@ -776,6 +848,33 @@ PCB *os_create_process(const char *name, void *start_point, INT32 priority,
     return pcb;
 }
 
+// Description: Fork the current process. The child is a new process
+// starting at its own entry point, as contexts cannot be copied, but its
+// address space is a copy-on-write clone of the caller's.
+// Parameter @name: The name of the child.
+// Parameter @start_point: The starting point of the child.
+// Parameter @priority: The priority of the child.
+// Parameter @error: The error returned from the function.
+// Return: On success, a pointer of the child is returned.  On error, NULL is returned.
+
+PCB *os_fork_process(const char *name, void *start_point, INT32 priority,
+                     long *error)
+{
+    PCB *pcb;
+
+    // The child cannot run before the caller returns from the system call.
+    pcb = os_create_process(name, start_point, priority, error);
+    if (pcb)
+    {
+        pcb->fault_around = CurrentPCB->fault_around;
+        pcb->virtual_pages = CurrentPCB->virtual_pages;
+        pcb->frame_quota = CurrentPCB->frame_quota;
+        pcb->large_pages = CurrentPCB->large_pages;
+        clone_address_space(CurrentPCB->pid, pcb->pid);
+    }
+    return pcb;
+}
+
 // Description: Make a process sleep for a certain mount of time.
 // Add the process who needs to sleep to the timer queue, and start the timer.
 // Parameter @sleep_time: The time within which the process is going to sleep.
@@ -1009,13 +1108,19 @@ void os_dispatcher(void)
 {
     int result;
 
+    if (CurrentPCB)
+        collect_tlb_stats(CurrentPCB->pid);
+
 #ifdef DEBUG_STAGE
     stage_info(CurrentPCB, "Enter dispather...");
 #endif
 
-    // Wait until ReadyQueue is not null.
+    // Wait until ReadyQueue is not null. With nothing left to wait for,
+    // a swapped process is let back in rather than idling forever.
     while (queue_is_empty(ReadyQueue))
     {
+        if (queue_is_empty(SuspendQueue) && swap_in_process())
+            continue;
         idle_and_wait();
 
 #ifdef DEBUG_STAGE
@@ -1050,7 +1155,10 @@ void os_dispatcher(void)
 // Description: Terminate certain process. If the pid equals -1 or the ID
 // of the running process, then remove it from the global process table.
 // Dequeue the first item in the ready queue, and switch to it. Or delete
-// the process with the ID from every position where it exists.
+// the process with the ID from every position where it exists. A process
+// which is waiting for disk I/O, or whose frame is being written back, is
+// only marked as a zombie, and reap_zombies() finishes it once the I/O is
+// done.
 // Parameter @pid: The process to be terminated.
 // Parameter @name: The error returned from the function.
 // Return: None.
@@ -1058,18 +1166,55 @@ void os_dispatcher(void)
 void os_terminate_process(INT32 pid, long *error)
 {
     int result;
+    PCB *pcb;
 
     assert(error);
 
-    get_data_lock(COMMON_DATA_LOCK);
-
     // Validate parameters.
     if (pid < -2 || pid >= MAX_NUMBER_OF_USER_PROCESSES)
     {
         *error = ERR_BAD_PARAM;
         return;
     }
-    else if (pid == -1 || CurrentPCB->pid == pid) // Terminate current process.
+    if (pid >= 0 && ProcessTable[pid] == NULL)
+    {
+        *error = ERR_PROCESS_DOESNT_EXIST;
+        return;
+    }
+    if (pid == CurrentPCB->pid)
+        pid = -1;
+
+    // Pages mapped from a disk are written back while the process still has
+    // them, and its pages being read ahead are waited for. A process in the
+    // middle of disk I/O does that itself once its I/O is done.
+    pcb = pid == -1 ? CurrentPCB : ProcessTable[pid];
+    if (pid >= 0 && !pcb->zombie && !pcb->in_disk_io)
+    {
+        sync_disk_maps(pid);
+        finish_read_ahead(pid);
+    }
+    else if (pid == -1)
+    {
+        sync_disk_maps(CurrentPCB->pid);
+        finish_read_ahead(CurrentPCB->pid);
+    }
+    // While we waited for the disk, the process may have terminated or
+    // started I/O of its own.
+    if (pid >= 0 && ProcessTable[pid] != pcb)
+    {
+        *error = ERR_SUCCESS;
+        return;
+    }
+    if (pid >= 0 && (pcb->zombie || pcb->in_disk_io))
+    {
+        pcb->zombie = TRUE;
+        *error = ERR_SUCCESS;
+        return;
+    }
+
+    get_data_lock(COMMON_DATA_LOCK);
+
+    if (pid == -1) // Terminate current process.
     {
         if (CurrentPCB->pid == RootPCB->pid)
         {
@@ -1084,6 +1229,8 @@ void os_terminate_process(INT32 pid, long *error)
             while (queue_is_empty(ReadyQueue))
             {
                 // If no process is ready, just wait.
+                if (queue_is_empty(SuspendQueue) && swap_in_process())
+                    continue;
                 idle_and_wait();
             }
 
@@ -1093,8 +1240,14 @@ void os_terminate_process(INT32 pid, long *error)
 
             get_data_lock(COMMON_DATA_LOCK);
 
-            // Remove current pcb from global process table.
-            result = remove_from_process_table(CurrentPCB);
+            collect_tlb_stats(CurrentPCB->pid);
+            if (release_address_space(CurrentPCB->pid))
+            {
+                // Remove current pcb from global process table.
+                result = remove_from_process_table(CurrentPCB);
+            }
+            else
+                result = add_to_zombie_queue(CurrentPCB);
 
 #ifdef DEBUG_PROCESS
             if (result)
@@ -1135,7 +1288,6 @@ void os_terminate_process(INT32 pid, long *error)
     }
     else // Delete the process with the pid from every position where it exists.
     {
-        PCB *pcb;
         size_t size;
         INT32 time_now;
         long time_to_sleep;
@@ -1196,12 +1348,32 @@ void os_terminate_process(INT32 pid, long *error)
                 shut_down();
             }
         }
+        // Find from SwappedQueue.
+        element = find_from_queue_by_condition(SwappedQueue, fp_match, (void *) (long) pid);
+        if (element != NULL)
+        {
+            result = queue_remove_element(SwappedQueue, element,
+                                          (void **) &pcb);
+            if (result)
+                print_scheduling_info(ACTION_NAME_DONE, CurrentPCB, NORMAL_INFO);
+            else
+            {
+                error_message("queue_remove_element");
+                shut_down();
+            }
+        }
 #ifdef DEBUG_PROCESS
         print_process_table();
 #endif
 
-        // Remove from global process table.
-        result = remove_from_process_table(pcb);
+        // A frame of the process being written back keeps it as a zombie.
+        if (release_address_space(pid))
+        {
+            // Remove from global process table.
+            result = remove_from_process_table(pcb);
+        }
+        else
+            result = add_to_zombie_queue(pcb);
 
 #ifdef DEBUG_PROCESS
         if (result)
@@ -1584,10 +1756,12 @@ int enqueue_suspend_queue_reversly(PCB *pcb)
 /**
  * Remove the process from suspend queue by given disk id.
  * @param disk_id: The disk id needs to be matched of the process.
+ * @param started: TRUE to find the process whose request is running on the
+ * disk, FALSE to find a process still waiting to start its request.
  * @return If succeeds, the pcb is returned.
  * If the queue is empty or the operation fails, NULL is returned.
  */
-PCB *remove_from_suspend_queue_by_disk_id(INT16 disk_id)
+PCB *remove_from_suspend_queue_by_disk_id(INT16 disk_id, BOOL started)
 {
     if (!SuspendQueue)
         return NULL;
@@ -1595,7 +1769,7 @@ PCB *remove_from_suspend_queue_by_disk_id(INT16 disk_id)
     PCB *pcb;
     int result;
     QueueElement *element;
-    fp_match = match_disk_id;
+    fp_match = started ? match_disk_started : match_disk_pending;
 
     element = find_from_queue_by_condition(SuspendQueue, fp_match, (void *) disk_id);
     if (!element)
@@ -1611,3 +1785,168 @@ PCB *remove_from_suspend_queue_by_disk_id(INT16 disk_id)
         return pcb;
     }
 }
+
+/**
+ * Take the lowest priority process other than the root off the ready queue
+ * and park it in the swapped queue, where the dispatcher does not look.
+ * @return: The process swapped out, NULL if no such process is ready.
+ */
+PCB *swap_out_process(void)
+{
+    PCB *pcb = NULL;
+    QueueElement *element;
+    int result;
+
+    get_data_lock(READY_QUEUE_LOCK);
+    // The ready queue is sorted by priority, the last one is the least important.
+    for (element = queue_head(ReadyQueue); element; element = queue_next(element))
+    {
+        if ((PCB *) queue_data(element) != RootPCB)
+            pcb = (PCB *) queue_data(element);
+    }
+    if (pcb && !remove_from_ready_queue(&pcb))
+    {
+        error_message("remove_from_ready_queue");
+        shut_down();
+    }
+    release_data_lock(READY_QUEUE_LOCK);
+    if (!pcb)
+        return NULL;
+
+    fp_compare = compare_priority;
+    result = queue_enqueue_orderly(SwappedQueue, fp_compare, ASCENDING, pcb);
+    if (!result)
+    {
+        error_message("queue_enqueue_orderly");
+        shut_down();
+    }
+    print_scheduling_info(ACTION_NAME_SWAP_OUT, pcb, NORMAL_INFO);
+    return pcb;
+}
+
+/**
+ * Put the highest priority swapped process back on the ready queue.
+ * @return: The process swapped in, NULL if no process is swapped out.
+ */
+PCB *swap_in_process(void)
+{
+    PCB *pcb;
+    int result;
+
+    if (queue_is_empty(SwappedQueue))
+        return NULL;
+    if (!queue_dequeue(SwappedQueue, (void **) &pcb))
+    {
+        error_message("queue_dequeue");
+        shut_down();
+    }
+    get_data_lock(READY_QUEUE_LOCK);
+    result = add_to_ready_queue(pcb);
+    release_data_lock(READY_QUEUE_LOCK);
+    if (!result)
+    {
+        error_message("add_to_ready_queue");
+        shut_down();
+    }
+    print_scheduling_info(ACTION_NAME_SWAP_IN, pcb, NORMAL_INFO);
+    return pcb;
+}
+
+/**
+ * Block the running process until another process wakes it with
+ * os_wake_process(), and dispatch the next ready process meanwhile. The
+ * process waits in the suspend queue without a disk, so no disk interrupt
+ * can take it for one of its own.
+ */
+void os_block_process(void)
+{
+    int result;
+
+    CurrentPCB->disk_id = 0;
+    CurrentPCB->operation = WAIT_USERFAULT;
+    get_data_lock(SUSPEND_QUEUE_LOCK);
+    result = add_to_suspend_queue(CurrentPCB);
+    release_data_lock(SUSPEND_QUEUE_LOCK);
+    if (result)
+    {
+        CurrentPCB->suspend = TRUE;
+        print_scheduling_info(ACTION_NAME_WAIT, CurrentPCB, NORMAL_INFO);
+    }
+    else
+    {
+        error_message("add_to_suspend_queue");
+        shut_down();
+    }
+    os_dispatcher();
+}
+
+/**
+ * Make a process blocked by os_block_process() ready again. A process which
+ * is not blocked that way is left alone.
+ * @param pid: The process to wake.
+ */
+void os_wake_process(INT32 pid)
+{
+    PCB *pcb = ProcessTable[pid];
+    QueueElement *element;
+
+    if (!pcb)
+        return;
+    // Not through fp_match, which a disk interrupt may set meanwhile.
+    get_data_lock(SUSPEND_QUEUE_LOCK);
+    element = find_from_queue_by_condition(SuspendQueue, match_pcb, pcb);
+    if (element && pcb->operation == WAIT_USERFAULT)
+    {
+        if (!queue_remove_element(SuspendQueue, element, (void **) &pcb))
+        {
+            error_message("queue_remove_element");
+            shut_down();
+        }
+        pcb->operation = -1;
+        pcb->suspend = FALSE;
+        add_to_ready_queue(pcb);
+        print_scheduling_info(ACTION_NAME_READY, pcb, NORMAL_INFO);
+    }
+    release_data_lock(SUSPEND_QUEUE_LOCK);
+}
+
+/**
+ * Finish the termination of zombies, see os_terminate_process(). A zombie
+ * in the zombie queue is removed once its address space could be released.
+ * The running process, if it is a zombie, has just finished its disk I/O
+ * and terminates itself now; then the call does not return. Before the
+ * first process is created (test0), there is no running process.
+ * Called when a process leaves the OS, after a fault or a system call.
+ */
+void reap_zombies(void)
+{
+    QueueElement *element;
+    QueueElement *next;
+    PCB *pcb;
+    long error;
+
+    for (element = queue_head(ZombieQueue); element; element = next)
+    {
+        next = queue_next(element);
+        pcb = (PCB *) queue_data(element);
+        get_data_lock(COMMON_DATA_LOCK);
+        if (!release_address_space(pcb->pid))
+        {
+            release_data_lock(COMMON_DATA_LOCK);
+            continue;
+        }
+        if (!queue_remove_element(ZombieQueue, element, (void **) &pcb))
+        {
+            error_message("queue_remove_element");
+            shut_down();
+        }
+        if (!remove_from_process_table(pcb))
+        {
+            error_message("remove_from_process_table");
+            shut_down();
+        }
+        release_data_lock(COMMON_DATA_LOCK);
+    }
+    if (CurrentPCB && CurrentPCB->zombie)
+        os_terminate_process(-1, &error);
+}
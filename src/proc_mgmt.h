@@ -21,11 +21,17 @@ typedef struct process
     void *entry_point;
     BOOL suspend;
     BOOL need_message;
+    BOOL zombie; // Terminated, but waiting for its disk I/O to be done
+    BOOL in_disk_io; // Suspended on a disk, or woken and not yet returned
     INT16 disk_id;
     INT16 operation;
     INT32 disk;
     INT32 sector;
     DISK_DATA *disk_data;
+    INT32 fault_around;
+    INT32 virtual_pages;
+    INT32 frame_quota;
+    BOOL large_pages;
     char process_name[MAX_NUMBER_OF_PROCESSE_NAME + 1];
 } PCB;
 
@@ -82,6 +88,13 @@ int add_to_process_table(PCB *pcb_to_add);
 // Return: On success, 1 is returned.  On error, 0 is returned.
 int remove_from_process_table(PCB *pcb_to_remove);
 
+// Description: Park a terminated process whose frames are still being
+// written back. It stays in the global process table, so its pid is not
+// reused, until reap_zombies() removes it.
+// Parameter @pcb: The terminated process.
+// Return: On success, 1 is returned.  On error, 0 is returned.
+int add_to_zombie_queue(PCB *pcb);
+
 // Description: Print scheduling information by using scheduler printer.
 // Parameter @action_mode: The string indicates the action mode.
 // Parameter @target_pcb: The process on which the scheduler action is being performed.
@@ -182,6 +195,17 @@ PCB *create_pcb(const char *name, void *start_point, INT32 priority,
 PCB *os_create_process(const char *name, void *start_point, INT32 priority,
         long *error);
 
+// Description: Fork the current process. The child is a new process
+// starting at its own entry point, as contexts cannot be copied, but its
+// address space is a copy-on-write clone of the caller's.
+// Parameter @name: The name of the child.
+// Parameter @start_point: The starting point of the child.
+// Parameter @priority: The priority of the child.
+// Parameter @error: The error returned from the function.
+// Return: On success, a pointer of the child is returned.  On error, NULL is returned.
+PCB *os_fork_process(const char *name, void *start_point, INT32 priority,
+        long *error);
+
 // Description: Make a process sleep for a certain mount of time.
 // Add the process who needs to sleep to the timer queue, and start the timer.
 // Parameter @sleep_time: The time within which the process is going to sleep.
@@ -206,7 +230,10 @@ void os_dispatcher(void);
 // Description: Terminate certain process. If the pid equals -1 or the ID
 // of the running process, then remove it from the global process table.
 // Dequeue the first item in the ready queue, and switch to it. Or delete
-// the process with the ID from every position where it exists.
+// the process with the ID from every position where it exists. A process
+// which is waiting for disk I/O, or whose frame is being written back, is
+// only marked as a zombie, and reap_zombies() finishes it once the I/O is
+// done.
 // Parameter @pid: The process to be terminated.
 // Parameter @name: The error returned from the function.
 // Return: None.
@@ -256,9 +283,44 @@ int enqueue_suspend_queue_reversly(PCB *pcb);
 /**
  * Remove the process from suspend queue by given disk id.
  * @param disk_id: The disk id needs to be matched of the process.
+ * @param started: TRUE to find the process whose request is running on the
+ * disk, FALSE to find a process still waiting to start its request.
  * @return If succeeds, the pcb is returned.
  * If the queue is empty or the operation fails, NULL is returned.
  */
-PCB *remove_from_suspend_queue_by_disk_id(INT16 disk_id);
+PCB *remove_from_suspend_queue_by_disk_id(INT16 disk_id, BOOL started);
+/**
+ * Take the lowest priority process other than the root off the ready queue
+ * and park it in the swapped queue, where the dispatcher does not look.
+ * @return: The process swapped out, NULL if no such process is ready.
+ */
+PCB *swap_out_process(void);
+/**
+ * Put the highest priority swapped process back on the ready queue.
+ * @return: The process swapped in, NULL if no process is swapped out.
+ */
+PCB *swap_in_process(void);
+/**
+ * Block the running process until another process wakes it with
+ * os_wake_process(), and dispatch the next ready process meanwhile. The
+ * process waits in the suspend queue without a disk, so no disk interrupt
+ * can take it for one of its own.
+ */
+void os_block_process(void);
+/**
+ * Make a process blocked by os_block_process() ready again. A process which
+ * is not blocked that way is left alone.
+ * @param pid: The process to wake.
+ */
+void os_wake_process(INT32 pid);
+/**
+ * Finish the termination of zombies, see os_terminate_process(). A zombie
+ * in the zombie queue is removed once its address space could be released.
+ * The running process, if it is a zombie, has just finished its disk I/O
+ * and terminates itself now; then the call does not return. Before the
+ * first process is created (test0), there is no running process.
+ * Called when a process leaves the OS, after a fault or a system call.
+ */
+void reap_zombies(void);
 
 #endif	/* PROC_MGMT_H */
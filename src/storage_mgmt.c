@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
@@ -13,34 +14,436 @@
 
 Queue *DiskQueue;
 Queue *FrameQueue;
+Queue *ZeroFrameQueue;
+Queue *FastFrameQueue;
 extern PCB *CurrentPCB;
+extern PCB *ProcessTable[MAX_NUMBER_OF_USER_PROCESSES];
 extern Queue *SuspendQueue;
 extern FuncMatch fp_match;
-extern UINT16 *Z502_PAGE_TBL_ADDR;
+extern UINT32 **Z502_PAGE_DIR_ADDR;
 extern INT16 Z502_PAGE_TBL_LENGTH;
-extern char MEMORY[PHYS_MEM_PGS * PGSIZE];
+extern char *MEMORY;
 extern long Z502_REG3;
-UINT16 *shadow_pg_tbl[PHYS_MEM_PGS];
-UINT16 process_holder[PHYS_MEM_PGS];
-UINT16 *address_holder[10];
-int shadow_pg_idx = -1;
+extern UINT32 CurrentSimulationTime;
+UINT32 *shadow_pg_tbl[MAX_ALL_MEM_PGS];
+UINT16 process_holder[MAX_ALL_MEM_PGS];
+INT32 vpn_holder[MAX_ALL_MEM_PGS];
+// Page directories per process, indexed by pid. The second level tables
+// and their swap maps are allocated the first time a region is touched.
+UINT32 **page_dir_holder[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 **swap_dir_holder[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 page_dir_length[MAX_NUMBER_OF_USER_PROCESSES];
 int ref_idx = -1;
 
+// Swap slot bookkeeping, see allocate_swap_slot(). A slot is referenced by
+// every swap map entry naming it, a fork shares the slots of the parent.
+char swap_slot_refs[NUM_OF_SWAP_SLOTS];
+INT32 swap_slots_free[MAX_NUMBER_OF_DISKS];
+INT32 swap_write_head[MAX_NUMBER_OF_DISKS];
+INT32 swap_segment_live[MAX_NUMBER_OF_DISKS][SWAP_SEGMENTS_PER_DISK];
+INT32 swap_disk_turn = 0;
+// The disk of the current burst of page-outs, and the slots it has left.
+INT32 swap_burst_disk = 0;
+INT32 swap_burst_left = 0;
+// Outstanding requests and the last sector requested per disk, indexed by disk id.
+INT32 disk_load[MAX_NUMBER_OF_DISKS + 1];
+INT32 disk_arm[MAX_NUMBER_OF_DISKS + 1];
+// Writes to swap slots and the sectors the arm moved for them.
+INT32 swap_log_writes = 0;
+INT32 swap_log_seek = 0;
+
+// Frames which hold a page read ahead but not yet mapped, see read_ahead().
+char swap_cache[MAX_ALL_MEM_PGS];
+// Frames a read ahead is still filling, and the frame each disk is reading
+// ahead into, indexed by disk id, -1 for none. Such a frame is kept from any
+// other use until the interrupt of its read.
+char reading_ahead[MAX_ALL_MEM_PGS];
+INT16 read_ahead_frame[MAX_NUMBER_OF_DISKS + 1];
+// Frames which hold a page that was never swapped out. While such a page is
+// not modified, it has no content worth keeping and is dropped on eviction.
+char fresh_frame[MAX_ALL_MEM_PGS];
+// Frames whose page is being written to its swap slot. Such a frame stays in
+// the swap cache until the write is done, so its owner can still fault the
+// page back in, but it may not be chosen as a victim.
+char writing_back[MAX_ALL_MEM_PGS];
+// Fault pattern and read-ahead window per process, indexed by pid.
+INT32 last_fault_vpn[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 fault_stride[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 read_ahead_window[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 read_ahead_issued = 0;
+INT32 read_ahead_hits = 0;
+INT32 read_ahead_waits = 0;
+INT32 read_ahead_wasted = 0;
+INT32 fault_around_mapped = 0;
+INT32 zero_pool_hits = 0;
+INT32 zero_pool_misses = 0;
+// TLB counters per process, indexed by pid, see collect_tlb_stats().
+INT32 tlb_hits[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 tlb_misses[MAX_NUMBER_OF_USER_PROCESSES];
+// Fault count of the current load control window, see control_load().
+INT32 load_window_start = 0;
+INT32 load_window_faults = 0;
+INT32 load_swap_outs = 0;
+INT32 load_swap_ins = 0;
+INT32 load_pages_evicted = 0;
+// Resident set accounting per process, indexed by pid, see frame_limit().
+INT32 resident_pages[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 frame_target[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 frame_quota[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 last_fault_time[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 total_frame_target = 0;
+// Processes waiting for a frame while every frame is in flight, see
+// wait_for_frame().
+BOOL frame_waiter[MAX_NUMBER_OF_USER_PROCESSES];
+// Priority-aware replacement, see run_clock(). clock_chances counts the
+// sweeps an unreferenced page still survives. Faults and memory accesses are
+// counted per priority, to compare the fault rates of the priorities.
+char clock_chances[MAX_ALL_MEM_PGS];
+INT32 priority_spared = 0;
+INT32 priority_faults[MAX_PRIORITY + 1];
+INT32 priority_accesses[MAX_PRIORITY + 1];
+// Paging statistics per process, indexed by pid, and for the whole system,
+// see account_fault(). fault_major marks a fault which read its page from a
+// disk, written_back a frame whose page was written out when it was last
+// written back.
+PAGING_STATS paging_stats[MAX_NUMBER_OF_USER_PROCESSES];
+PAGING_STATS system_paging_stats;
+char fault_major[MAX_NUMBER_OF_USER_PROCESSES];
+char written_back[MAX_ALL_MEM_PGS];
+// Frames on the inactive list, see deactivate_frame(). Inactive frames are
+// reclaimed oldest first. Ages and refault distances are counted in
+// deactivations; slot_evicted_at keeps the age a page had when it left
+// memory, so a refault from disk can still be measured.
+char inactive[MAX_ALL_MEM_PGS];
+INT32 inactive_since[MAX_ALL_MEM_PGS];
+INT32 slot_evicted_at[NUM_OF_SWAP_SLOTS];
+INT32 inactive_count = 0;
+INT32 deactivations = 0;
+INT32 inactive_refaults = 0;
+INT32 inactive_refault_distance = 0;
+INT32 disk_refaults = 0;
+INT32 disk_refault_distance = 0;
+INT32 disk_refaults_near = 0;
+// Shared areas, see os_define_shared_area(). A shared frame is charged to one
+// of the processes mapping it, shared_area_of names its area (-1 for private
+// frames) and frame_mappers counts the page tables it is entered in.
+SharedArea shared_areas[MAX_NUMBER_OF_SHARED_AREAS];
+INT16 shared_area_of[MAX_ALL_MEM_PGS];
+INT16 frame_mappers[MAX_ALL_MEM_PGS];
+INT32 shared_pages_mapped = 0;
+// Copy-on-write, see clone_address_space(). A frame shared by a fork stays
+// charged to its owner, the other processes map it with the protected bit.
+INT32 cow_pages_shared = 0;
+INT32 cow_copies = 0;
+INT32 cow_unprotected = 0;
+// Same-page merging, see merge_identical_frames().
+UINT32 frame_checksum[MAX_ALL_MEM_PGS];
+int merge_idx = -1;
+INT32 merge_scanned = 0;
+INT32 merge_merged = 0;
+// Compressed swap cache, see compress_page(). A cached slot has the mask of
+// its nonzero words in compressed_mask (-1 if the slot is not cached), and in
+// compressed_where the first word of the arena holding them, or the value a
+// same-filled page is filled with. compressed_owner is the process whose
+// page was stored, the one a spill is counted for.
+INT16 compressed_mask[NUM_OF_SWAP_SLOTS];
+INT32 compressed_where[NUM_OF_SWAP_SLOTS];
+INT32 compressed_stored_at[NUM_OF_SWAP_SLOTS];
+UINT16 compressed_owner[NUM_OF_SWAP_SLOTS];
+// The slot each word of the arena belongs to, one extra keeps it valid with
+// the cache turned off.
+INT32 arena_owner[COMPRESSED_CACHE_WORDS + 1];
+INT32 compressed_stores = 0;
+INT32 compressed_same_filled = 0;
+INT32 compressed_words = 0;
+INT32 compressed_hits = 0;
+INT32 compressed_spills = 0;
+// Memory tiers, see balance_memory_tiers(). The heat of a frame is the history
+// of the referenced bit of its page, shifted in from the top at every scan.
+unsigned char frame_heat[MAX_ALL_MEM_PGS];
+int tier_idx = -1;
+INT32 tier_promotions = 0;
+INT32 tier_demotions = 0;
+// Buddy allocator over the free frames, see buddy_allocate(). The first frame
+// of every free block of 2^order frames has the order in buddy_order, every
+// other frame -1. The blocks of an order are chained through buddy_next.
+INT16 buddy_order[MAX_ALL_MEM_PGS];
+INT16 buddy_next[MAX_ALL_MEM_PGS];
+INT16 buddy_free_list[LARGE_PAGE_ORDER + 1];
+// Large pages, see map_large_page() and collapse_large_pages().
+int collapse_idx = -1;
+// Memory advice per process, indexed by pid, oldest range first, see
+// os_memory_advice().
+AdviceRange advice_ranges[MAX_NUMBER_OF_USER_PROCESSES][MAX_NUMBER_OF_ADVICE_RANGES];
+INT32 advice_count[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 advice_calls = 0;
+INT32 advice_prefetched = 0;
+INT32 advice_dropped = 0;
+INT32 advice_dropped_behind = 0;
+// Disk maps per process, indexed by pid, see os_map_disk().
+DiskMap disk_maps[MAX_NUMBER_OF_USER_PROCESSES][MAX_NUMBER_OF_DISK_MAPS];
+INT32 disk_map_count[MAX_NUMBER_OF_USER_PROCESSES];
+// Logical sectors of every disk which were ever written, indexed by
+// disk id. A disk-mapped page whose sector was never written reads as zeros,
+// the disk itself refuses to read it.
+char sector_written[MAX_NUMBER_OF_DISKS + 1][NUM_LOGICAL_SECTORS];
+INT32 disk_map_reads = 0;
+INT32 disk_map_writes = 0;
+// User-level fault handling per process, indexed by pid, see
+// os_register_userfault(). A process blocked on a missing page has it in
+// userfault_vpn (-1 otherwise), its fault message is ordered by
+// userfault_raised_at. receiving_faults marks handlers blocked for a message.
+UserfaultRange userfault_ranges[MAX_NUMBER_OF_USER_PROCESSES][MAX_NUMBER_OF_USERFAULT_RANGES];
+INT32 userfault_count[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 userfault_vpn[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 userfault_handler[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 userfault_raised_at[MAX_NUMBER_OF_USER_PROCESSES];
+char userfault_delivered[MAX_NUMBER_OF_USER_PROCESSES];
+char receiving_faults[MAX_NUMBER_OF_USER_PROCESSES];
+INT32 userfaults_raised = 0;
+INT32 userfault_pages_installed = 0;
+INT32 large_pages_mapped = 0;
+INT32 large_page_fallbacks = 0;
+INT32 large_pages_collapsed = 0;
+INT32 local_evictions = 0;
+INT32 global_evictions = 0;
+
 /**
- * Initialize the frame queue and shallow page table.
+ * Initialize the frame queue and shallow page table. A memory smaller than
+ * MIN_MEM_PGS frames is refused.
  */
 void init_storage(void)
 {
     int i = 0;
-    for (i = 0; i < PHYS_MEM_PGS; i++)
+    if (ALL_MEM_PGS < MIN_MEM_PGS)
+    {
+        error_message("Physical memory is smaller than MIN_MEM_PGS frames.");
+        shut_down();
+    }
+    for (i = 0; i < MAX_ALL_MEM_PGS; i++)
+        buddy_order[i] = -1;
+    for (i = 0; i <= LARGE_PAGE_ORDER; i++)
+        buddy_free_list[i] = -1;
+    for (i = 0; i < ALL_MEM_PGS; i++)
     {
-        add_to_frame_queue((INT16) i);
+        if (i < ALL_MEM_PGS - COMPRESSED_CACHE_FRAMES)
+            add_to_frame_queue((INT16) i);
         shadow_pg_tbl[i] = NULL;
+        swap_cache[i] = FALSE;
+        reading_ahead[i] = FALSE;
+        fresh_frame[i] = FALSE;
+        writing_back[i] = FALSE;
+        inactive[i] = FALSE;
+        frame_checksum[i] = 0;
+        frame_heat[i] = 0;
+        shared_area_of[i] = -1;
+        frame_mappers[i] = 0;
+    }
+    for (i = 0; i < MAX_NUMBER_OF_SHARED_AREAS; i++)
+    {
+        shared_areas[i].pages = 0;
+        memset(shared_areas[i].start_vpn, -1, sizeof (shared_areas[i].start_vpn));
+    }
+    for (i = 0; i < NUM_OF_SWAP_SLOTS; i++)
+    {
+        swap_slot_refs[i] = 0;
+        compressed_mask[i] = -1;
+    }
+    for (i = 0; i < COMPRESSED_CACHE_WORDS; i++)
+        arena_owner[i] = NO_SWAP_SLOT;
+    for (i = 0; i < MAX_NUMBER_OF_DISKS; i++)
+    {
+        swap_slots_free[i] = SWAP_SECTORS_PER_DISK;
+        swap_write_head[i] = 0;
+        memset(swap_segment_live[i], 0, sizeof (swap_segment_live[i]));
+    }
+    for (i = 0; i <= MAX_NUMBER_OF_DISKS; i++)
+    {
+        disk_load[i] = 0;
+        disk_arm[i] = 0;
+        read_ahead_frame[i] = -1;
+    }
+    for (i = 0; i < MAX_NUMBER_OF_USER_PROCESSES; i++)
+        userfault_vpn[i] = -1;
+    system_paging_stats.free_frames_low_water = ALL_MEM_PGS;
+    refill_zero_pool();
+}
+
+/**
+ * Chain the head frame of a free block into the free list of its order.
+ * @param head: The first frame of the block.
+ * @param order: The block holds 2^order frames.
+ */
+static void buddy_link(INT16 head, int order)
+{
+    buddy_order[head] = (INT16) order;
+    buddy_next[head] = buddy_free_list[order];
+    buddy_free_list[order] = head;
+}
+
+/**
+ * Take a free block out of the free list of its order.
+ * @param head: The first frame of the block.
+ */
+static void buddy_unlink(INT16 head)
+{
+    INT16 *link = &buddy_free_list[buddy_order[head]];
+
+    while (*link != head)
+        link = &buddy_next[*link];
+    *link = buddy_next[head];
+    buddy_order[head] = -1;
+}
+
+/**
+ * Give a frame back to the buddy allocator, and merge it with its buddy
+ * for as long as the buddy is a free block of the same size.
+ * @param frame_number: The frame which became free.
+ */
+static void buddy_release(INT16 frame_number)
+{
+    INT16 buddy;
+    int order = 0;
+
+    while (order < LARGE_PAGE_ORDER)
+    {
+        buddy = frame_number ^ (1 << order);
+        if (buddy >= ALL_MEM_PGS || buddy_order[buddy] != order)
+            break;
+        buddy_unlink(buddy);
+        if (buddy < frame_number)
+            frame_number = buddy;
+        order++;
+    }
+    buddy_link(frame_number, order);
+}
+
+/**
+ * Take a single frame out of the free block which holds it, and give the
+ * rest of the block back in halves.
+ * @param frame_number: The free frame taken from a frame queue.
+ */
+static void buddy_claim(INT16 frame_number)
+{
+    INT16 head = frame_number;
+    INT16 half;
+    int order;
+
+    for (order = 0; order <= LARGE_PAGE_ORDER; order++)
+    {
+        head = frame_number & ~((1 << order) - 1);
+        if (buddy_order[head] == order)
+            break;
+    }
+    if (order > LARGE_PAGE_ORDER)
+    {
+        error_message("A frame taken from a frame queue is not free.");
+        shut_down();
+    }
+    buddy_unlink(head);
+    while (order > 0)
+    {
+        order--;
+        half = head + (1 << order);
+        if (frame_number >= half)
+        {
+            buddy_link(head, order);
+            head = half;
+        }
+        else
+            buddy_link(half, order);
+    }
+}
+
+/**
+ * Allocate an aligned run of free frames, split from the smallest free block
+ * which is large enough. A block of the fast tier is preferred.
+ * @param order: The run holds 2^order frames.
+ * @return: The first frame of the run, -1 if there is no such run. The frames
+ * are still in the frame queues.
+ */
+static INT16 buddy_allocate(int order)
+{
+    INT16 head = -1;
+    INT16 candidate;
+    int size;
+
+    for (size = order; size <= LARGE_PAGE_ORDER && head < 0; size++)
+        for (candidate = buddy_free_list[size]; candidate >= 0; candidate = buddy_next[candidate])
+            if (head < 0 || (is_fast_frame(candidate) && !is_fast_frame(head)))
+                head = candidate;
+    if (head < 0)
+        return -1;
+    size = buddy_order[head];
+    buddy_unlink(head);
+    while (size > order)
+    {
+        size--;
+        buddy_link(head + (1 << size), size);
+    }
+    return head;
+}
+
+/**
+ * Match a frame of a frame queue by its number.
+ * @param data1: The frame.
+ * @param data2: The number of the frame.
+ * @return: Nonzero if the frame has that number.
+ */
+static int match_frame(const void *data1, const void *data2)
+{
+    return ((const Frame *) data1)->frame_number == *(const INT16 *) data2;
+}
+
+/**
+ * Take a free frame out of whichever frame queue holds it.
+ * @param frame_number: The frame.
+ * @return: TRUE if the frame had been zeroed.
+ */
+static BOOL take_queued_frame(INT16 frame_number)
+{
+    Queue *queues[3];
+    QueueElement *element;
+    Frame *frm;
+    int i;
+
+    queues[0] = ZeroFrameQueue;
+    queues[1] = FrameQueue;
+    queues[2] = FastFrameQueue;
+    for (i = 0; i < 3; i++)
+    {
+        element = queue_find_element(queues[i], match_frame, &frame_number);
+        if (element && queue_remove_element(queues[i], element, (void **) &frm))
+        {
+            free(frm);
+            return queues[i] == ZeroFrameQueue;
+        }
     }
+    error_message("A frame of a free run is in no frame queue.");
+    shut_down();
+    return FALSE;
+}
+
+/**
+ * Wake the processes waiting in wait_for_frame(), since a frame may have
+ * become one to take: a write back is done, or a frame got a page or was
+ * freed.
+ */
+static void wake_frame_waiters(void)
+{
+    INT32 pid;
+
+    for (pid = 0; pid < MAX_NUMBER_OF_USER_PROCESSES; pid++)
+        if (frame_waiter[pid])
+        {
+            frame_waiter[pid] = FALSE;
+            os_wake_process(pid);
+        }
 }
 
 /**
- * Create a frame and add it to the frame queue.
+ * Create a frame and add it to the frame queue. Frames of the fast tier go
+ * to their own queue, which is only used once the slow tier is full.
  * @param frame_number: Used as the id of the newly created frame.
  * @return: The value indicates whether the action succeeds.
  */
@@ -50,9 +453,65 @@ int add_to_frame_queue(INT16 frame_number)
     if (!frm)
         return 0;
     frm->frame_number = frame_number;
+    buddy_release(frame_number);
+    wake_frame_waiters();
+    if (is_fast_frame(frame_number))
+        return queue_enqueue(FastFrameQueue, frm);
     return queue_enqueue(FrameQueue, frm);
 }
 
+/**
+ * Lower the free frame low-water mark to the free frames left, if fewer.
+ */
+static void note_free_frames(void)
+{
+    INT32 free_frames = FrameQueue->size + FastFrameQueue->size + ZeroFrameQueue->size;
+
+    if (free_frames < system_paging_stats.free_frames_low_water)
+        system_paging_stats.free_frames_low_water = free_frames;
+}
+
+/**
+ * Count a page read from a disk for a process.
+ * @param pid: The process which owns the page.
+ */
+static void count_page_in(INT32 pid)
+{
+    paging_stats[pid].page_ins++;
+    system_paging_stats.page_ins++;
+}
+
+/**
+ * Count a page written to a disk for a process.
+ * @param pid: The process which owns the page.
+ */
+static void count_page_out(INT32 pid)
+{
+    paging_stats[pid].page_outs++;
+    system_paging_stats.page_outs++;
+}
+
+/**
+ * Count the eviction of the page a frame holds, as dirty if the page was
+ * written out when the frame was last written back.
+ * @param frame_number: The frame, still attached to its page.
+ */
+static void count_eviction(INT16 frame_number)
+{
+    INT32 pid = process_holder[frame_number];
+
+    if (written_back[frame_number])
+    {
+        paging_stats[pid].dirty_evictions++;
+        system_paging_stats.dirty_evictions++;
+    }
+    else
+    {
+        paging_stats[pid].clean_evictions++;
+        system_paging_stats.clean_evictions++;
+    }
+}
+
 /**
  * Get the number of the newly removed frame from free frame queue.
  * @return: The number of the frame, if there is no more free frame, -1 is returned.
@@ -60,25 +519,349 @@ int add_to_frame_queue(INT16 frame_number)
 INT16 get_frame_number_of_removed_frame(void)
 {
     Frame *frm = removed_from_frame_queue();
+
+    note_free_frames();
     return frm ? frm->frame_number : -1;
 }
 
 /**
- * Remove a frame form the frame queue.
+ * Get the number of a free frame which has already been zeroed.
+ * @return: The number of the frame, if the zero pool is empty, -1 is returned.
+ */
+INT16 get_frame_number_of_zeroed_frame(void)
+{
+    Frame *frm;
+    INT16 frame_number;
+
+    if (!ZeroFrameQueue->size)
+        return -1;
+    queue_dequeue(ZeroFrameQueue, (void**) &frm);
+    frame_number = frm->frame_number;
+    buddy_claim(frame_number);
+    free(frm);
+    note_free_frames();
+    return frame_number;
+}
+
+/**
+ * Zero the frames of the free frame queue and move them to the zero pool.
+ * Called when the OS is idle, so new pages find a clean frame ready.
+ */
+void refill_zero_pool(void)
+{
+    Frame *frm;
+
+    while (FrameQueue->size)
+    {
+        queue_dequeue(FrameQueue, (void**) &frm);
+        memset(&MEMORY[frm->frame_number * PGSIZE], 0, PGSIZE);
+        queue_enqueue(ZeroFrameQueue, frm);
+    }
+}
+
+/**
+ * Remove a frame form the frame queue. New pages start in the slow tier, a
+ * fast frame is only handed out when no slow one is free.
  * @return: If the queue is empty, NULL is returned, or the pointer to the frame is returned.
  */
 Frame *removed_from_frame_queue(void)
 {
     Frame *frm;
 
-    if (!FrameQueue->size)
-    {
+    if (FrameQueue->size)
+        queue_dequeue(FrameQueue, (void**) &frm);
+    else if (FastFrameQueue->size)
+        queue_dequeue(FastFrameQueue, (void**) &frm);
+    else
         return NULL;
+    buddy_claim(frm->frame_number);
+    return frm;
+}
+
+/**
+ * Pick the segment of a swap log the write head should continue in: the one with
+ * the fewest live slots, and of those the one closest to the last sector used on the disk.
+ * @param disk_idx: The index of the disk, which is its id minus one.
+ * @return: The number of the segment.
+ */
+static int select_clean_segment(int disk_idx)
+{
+    int segment;
+    int best = -1;
+    INT32 distance;
+    INT32 best_distance = 0;
+
+    for (segment = 0; segment < SWAP_SEGMENTS_PER_DISK; segment++)
+    {
+        distance = abs(disk_arm[disk_idx + 1]
+                       - (SWAP_START_SECTOR + segment * SWAP_SEGMENT_SLOTS));
+        if (best < 0
+                || swap_segment_live[disk_idx][segment] < swap_segment_live[disk_idx][best]
+                || (swap_segment_live[disk_idx][segment] == swap_segment_live[disk_idx][best]
+                && distance < best_distance))
+        {
+            best = segment;
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+/**
+ * Find a word of the compressed cache arena.
+ * @param word: The index of the word.
+ * @return: The pointer to the word, within the frames kept for the cache.
+ */
+static char *arena_word(INT32 word)
+{
+    return &MEMORY[(ALL_MEM_PGS - COMPRESSED_CACHE_FRAMES) * PGSIZE + word * 4];
+}
+
+/**
+ * Drop the compressed copy of a swap slot, if it has one.
+ * @param slot: The swap slot.
+ */
+static void drop_compressed_page(INT32 slot)
+{
+    INT32 word;
+
+    if (compressed_mask[slot] < 0)
+        return;
+    if (!(compressed_mask[slot] & COMPRESSED_SAME_FILL))
+        for (word = compressed_where[slot]; word < COMPRESSED_CACHE_WORDS
+                && arena_owner[word] == slot; word++)
+            arena_owner[word] = NO_SWAP_SLOT;
+    compressed_mask[slot] = -1;
+}
+
+/**
+ * Restore a page from its compressed copy.
+ * @param slot: The swap slot of the page.
+ * @param page: Returns the page, PGSIZE bytes.
+ * @return: TRUE if the slot is cached, FALSE if it has to be read from disk.
+ */
+static BOOL decompress_page(INT32 slot, char *page)
+{
+    INT32 word;
+    int i;
+
+    if (slot == NO_SWAP_SLOT || compressed_mask[slot] < 0)
+        return FALSE;
+    word = compressed_where[slot];
+    for (i = 0; i < PAGE_WORDS; i++)
+    {
+        if (compressed_mask[slot] & COMPRESSED_SAME_FILL)
+            memcpy(&page[i * 4], &compressed_where[slot], 4);
+        else if (compressed_mask[slot] & (1 << i))
+            memcpy(&page[i * 4], arena_word(word++), 4);
+        else
+            memset(&page[i * 4], 0, 4);
+    }
+    return TRUE;
+}
+
+/**
+ * Make room in the compressed cache by writing its oldest page to its swap
+ * slot. The page leaves the cache before the write, a fault on it meanwhile
+ * queues its read behind the write.
+ * @return: FALSE if the cache holds no page which takes room.
+ */
+static BOOL spill_compressed_page(void)
+{
+    char page[PGSIZE];
+    INT32 oldest = NO_SWAP_SLOT;
+    INT32 word;
+    INT32 Index = 0;
+
+    for (word = 0; word < COMPRESSED_CACHE_WORDS; word++)
+        if (arena_owner[word] != NO_SWAP_SLOT && (oldest == NO_SWAP_SLOT
+                || compressed_stored_at[arena_owner[word]] < compressed_stored_at[oldest]))
+            oldest = arena_owner[word];
+    if (oldest == NO_SWAP_SLOT)
+        return FALSE;
+
+    decompress_page(oldest, page);
+    drop_compressed_page(oldest);
+    compressed_spills++;
+    count_page_out(compressed_owner[oldest]);
+    write_to_memory(Z502InterruptClear, &Index);
+    os_disk_write(swap_slot_disk(oldest), swap_slot_sector(oldest), page);
+    return TRUE;
+}
+
+/**
+ * Store a page in the compressed cache instead of writing it to its swap
+ * slot. Only the nonzero words of the page are kept, in consecutive words
+ * of the arena, and a page filled with a single value only keeps the value.
+ * Older pages are spilled to disk until the new one fits. A page without
+ * any zero word is not worth compressing.
+ * @param slot: The swap slot of the page.
+ * @param page: The page, PGSIZE bytes.
+ * @return: TRUE if the page is cached, FALSE if it has to be written out.
+ */
+static BOOL compress_page(INT32 slot, char *page)
+{
+    INT32 words[PAGE_WORDS];
+    INT16 mask = 0;
+    INT32 count = 0;
+    INT32 start;
+    INT32 run;
+    int i;
+
+    if (COMPRESSED_CACHE_FRAMES == 0)
+        return FALSE;
+    drop_compressed_page(slot);
+    memcpy(words, page, PGSIZE);
+    for (i = 0; i < PAGE_WORDS; i++)
+    {
+        if (words[i])
+        {
+            mask |= 1 << i;
+            count++;
+        }
+    }
+    for (i = 1; i < PAGE_WORDS && words[i] == words[0]; i++)
+        ;
+    if (i == PAGE_WORDS)
+    {
+        compressed_mask[slot] = COMPRESSED_SAME_FILL;
+        compressed_where[slot] = words[0];
+        compressed_stored_at[slot] = compressed_stores++;
+        compressed_same_filled++;
+        return TRUE;
+    }
+    if (count == PAGE_WORDS)
+        return FALSE;
+
+    // First fit over the arena. Spilling waits for the disk, so the arena
+    // is searched again after every spill.
+    for (;;)
+    {
+        run = 0;
+        for (start = 0; start < COMPRESSED_CACHE_WORDS && run < count; start++)
+            run = arena_owner[start] == NO_SWAP_SLOT ? run + 1 : 0;
+        if (run == count)
+            break;
+        if (!spill_compressed_page())
+            return FALSE;
+    }
+    start -= count;
+    compressed_mask[slot] = mask;
+    compressed_where[slot] = start;
+    compressed_stored_at[slot] = compressed_stores++;
+    compressed_words += count;
+    for (i = 0; i < PAGE_WORDS; i++)
+    {
+        if (words[i])
+        {
+            memcpy(arena_word(start), &words[i], 4);
+            arena_owner[start++] = slot;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * Allocate a free swap slot at the write head of a disk. A burst of up to
+ * SWAP_BURST_SLOTS allocations stays on one disk, so its page-outs are appended
+ * in one sequential run. A new burst starts on the least busy disk which still
+ * has free slots, ties are broken round robin, so that bursts are striped across all disks.
+ * @return: The number of the slot, if swap space is exhausted, NO_SWAP_SLOT is returned.
+ */
+INT32 allocate_swap_slot(void)
+{
+    int i;
+    INT32 disk_idx;
+    INT32 best = -1;
+    INT32 slot;
+
+    for (i = 0; i < MAX_NUMBER_OF_DISKS; i++)
+    {
+        disk_idx = (swap_disk_turn + i) % MAX_NUMBER_OF_DISKS;
+        if (swap_slots_free[disk_idx] == 0)
+            continue;
+        if (best < 0 || disk_load[disk_idx + 1] < disk_load[best + 1])
+            best = disk_idx;
     }
+    if (best < 0)
+        return NO_SWAP_SLOT;
+
+    // The burst ends early when its disk runs out of slots, or when it is
+    // busier than another disk, so concurrent page-outs still spread.
+    if (swap_burst_left > 0 && swap_slots_free[swap_burst_disk]
+            && disk_load[swap_burst_disk + 1] <= disk_load[best + 1])
+        best = swap_burst_disk;
     else
     {
-        queue_dequeue(FrameQueue, (void**) &frm);
-        return frm;
+        swap_burst_disk = best;
+        swap_burst_left = SWAP_BURST_SLOTS;
+        swap_disk_turn = (best + 1) % MAX_NUMBER_OF_DISKS;
+    }
+    swap_burst_left--;
+
+    // Slots of one disk are best + k * MAX_NUMBER_OF_DISKS, append at the write head
+    // and skip the slots which are still live. When the head leaves a segment,
+    // it continues in the cleanest one instead of running on into older data.
+    for (;;)
+    {
+        slot = swap_write_head[best] * MAX_NUMBER_OF_DISKS + best;
+        swap_write_head[best]++;
+        if (swap_write_head[best] % SWAP_SEGMENT_SLOTS == 0)
+            swap_write_head[best] = select_clean_segment(best) * SWAP_SEGMENT_SLOTS;
+        if (!swap_slot_refs[slot])
+            break;
+    }
+    swap_slot_refs[slot] = 1;
+    drop_compressed_page(slot);
+    swap_slots_free[best]--;
+    swap_segment_live[best][slot / MAX_NUMBER_OF_DISKS / SWAP_SEGMENT_SLOTS]++;
+    return slot;
+}
+
+/**
+ * Drop a reference to a swap slot, the last one returns it to the free pool.
+ * @param slot: The slot to release, NO_SWAP_SLOT is ignored.
+ */
+void release_swap_slot(INT32 slot)
+{
+    if (slot == NO_SWAP_SLOT || !swap_slot_refs[slot])
+        return;
+    if (--swap_slot_refs[slot])
+        return;
+    drop_compressed_page(slot);
+    swap_slots_free[slot % MAX_NUMBER_OF_DISKS]++;
+    swap_segment_live[slot % MAX_NUMBER_OF_DISKS][slot / MAX_NUMBER_OF_DISKS / SWAP_SEGMENT_SLOTS]--;
+}
+
+/**
+ * Add a reference to a swap slot, for another swap map entry naming it.
+ * @param slot: The slot to share, NO_SWAP_SLOT is ignored.
+ */
+static void share_swap_slot(INT32 slot)
+{
+    if (slot != NO_SWAP_SLOT)
+        swap_slot_refs[slot]++;
+}
+
+/**
+ * Clean the swap logs, called when the OS is idle. For every disk whose write
+ * head is in a segment that is mostly live, the head is moved to the start of
+ * the cleanest segment, so appends do not keep skipping over live slots.
+ * Dead slots are reclaimed in place, no live page is copied.
+ */
+void clean_swap_log(void)
+{
+    int disk_idx;
+    int segment;
+
+    for (disk_idx = 0; disk_idx < MAX_NUMBER_OF_DISKS; disk_idx++)
+    {
+        segment = swap_write_head[disk_idx] / SWAP_SEGMENT_SLOTS;
+        if (swap_segment_live[disk_idx][segment] * 2 <= SWAP_SEGMENT_SLOTS)
+            continue;
+        segment = select_clean_segment(disk_idx);
+        if (segment != swap_write_head[disk_idx] / SWAP_SEGMENT_SLOTS)
+            swap_write_head[disk_idx] = segment * SWAP_SEGMENT_SLOTS;
     }
 }
 
@@ -93,7 +876,21 @@ void os_disk_write(INT32 disk_id, INT32 sector, char *buffer)
     INT32 status;
     int result;
 
+    if (disk_id >= 1 && disk_id <= MAX_NUMBER_OF_DISKS)
+    {
+        disk_load[disk_id]++;
+        if (sector >= SWAP_START_SECTOR)
+        {
+            swap_log_writes++;
+            swap_log_seek += abs(disk_arm[disk_id] - sector);
+        }
+        disk_arm[disk_id] = sector;
+        if (sector >= 0 && sector < NUM_LOGICAL_SECTORS)
+            sector_written[disk_id][sector] = TRUE;
+    }
+
     /* Do the hardware call to put data on disk */
+    get_data_lock(DISK_REGISTER_LOCK);
     write_to_memory(Z502DiskSetID, &disk_id);
     read_from_memory(Z502DiskStatus, &status);
 
@@ -113,6 +910,7 @@ void os_disk_write(INT32 disk_id, INT32 sector, char *buffer)
         get_data_lock(SUSPEND_QUEUE_LOCK);
         result = add_to_suspend_queue(CurrentPCB);
         release_data_lock(SUSPEND_QUEUE_LOCK);
+        release_data_lock(DISK_REGISTER_LOCK);
         if (result)
         {
             CurrentPCB->suspend = TRUE;
@@ -123,8 +921,9 @@ void os_disk_write(INT32 disk_id, INT32 sector, char *buffer)
             error_message("add_to_suspend_queue");
             shut_down();
         }
+        CurrentPCB->in_disk_io = TRUE;
         os_dispatcher();
-        return;
+        CurrentPCB->in_disk_io = FALSE;
     }
     // If the disk is busy, indicates failure in writing.
     else if (status == DEVICE_IN_USE)
@@ -139,6 +938,7 @@ void os_disk_write(INT32 disk_id, INT32 sector, char *buffer)
         memcpy(disk_data, buffer, sizeof (DISK_DATA));
         CurrentPCB->disk_data = disk_data;
         result = add_to_suspend_queue(CurrentPCB);
+        release_data_lock(DISK_REGISTER_LOCK);
         if (result)
         {
             CurrentPCB->suspend = TRUE;
@@ -149,11 +949,13 @@ void os_disk_write(INT32 disk_id, INT32 sector, char *buffer)
             error_message("add_to_suspend_queue");
             shut_down();
         }
+        CurrentPCB->in_disk_io = TRUE;
         os_dispatcher();
-        return;
+        CurrentPCB->in_disk_io = FALSE;
     }
     else
     {
+        release_data_lock(DISK_REGISTER_LOCK);
         printf("some error not processed in os_disk_write!\n");
     }
 }
@@ -169,6 +971,13 @@ void os_disk_read(INT32 disk_id, INT32 sector, char *buffer)
     INT32 status;
     int result;
 
+    if (disk_id >= 1 && disk_id <= MAX_NUMBER_OF_DISKS)
+    {
+        disk_load[disk_id]++;
+        disk_arm[disk_id] = sector;
+    }
+
+    get_data_lock(DISK_REGISTER_LOCK);
     write_to_memory(Z502DiskSetID, &disk_id);
     read_from_memory(Z502DiskStatus, &status);
     // Disk hasn't been used - should be free
@@ -187,6 +996,7 @@ void os_disk_read(INT32 disk_id, INT32 sector, char *buffer)
         get_data_lock(SUSPEND_QUEUE_LOCK);
         result = add_to_suspend_queue(CurrentPCB);
         release_data_lock(SUSPEND_QUEUE_LOCK);
+        release_data_lock(DISK_REGISTER_LOCK);
         if (result)
         {
             CurrentPCB->suspend = TRUE;
@@ -197,7 +1007,9 @@ void os_disk_read(INT32 disk_id, INT32 sector, char *buffer)
             error_message("add_to_suspend_queue");
             shut_down();
         }
+        CurrentPCB->in_disk_io = TRUE;
         os_dispatcher();
+        CurrentPCB->in_disk_io = FALSE;
     }
     else if (status == DEVICE_IN_USE)
     {
@@ -210,6 +1022,7 @@ void os_disk_read(INT32 disk_id, INT32 sector, char *buffer)
         get_data_lock(SUSPEND_QUEUE_LOCK);
         result = add_to_suspend_queue(CurrentPCB);
         release_data_lock(SUSPEND_QUEUE_LOCK);
+        release_data_lock(DISK_REGISTER_LOCK);
         if (result)
         {
             CurrentPCB->suspend = TRUE;
@@ -220,8 +1033,65 @@ void os_disk_read(INT32 disk_id, INT32 sector, char *buffer)
             error_message("add_to_suspend_queue");
             shut_down();
         }
+        CurrentPCB->in_disk_io = TRUE;
         os_dispatcher();
+        CurrentPCB->in_disk_io = FALSE;
+    }
+    else
+    {
+        release_data_lock(DISK_REGISTER_LOCK);
+        printf("some error not processed in os_disk_read!\n");
+    }
+}
+
+/**
+ * Check that a sector a user process asks for is a logical one.
+ * @param disk_id: The disk of the sector.
+ * @param sector: The sector.
+ * @param error: Set to ERR_BAD_PARAM if the sector cannot be reached by user
+ * processes, ERR_SUCCESS otherwise.
+ * @return: TRUE if the process may access the sector.
+ */
+static BOOL check_user_sector(INT32 disk_id, INT32 sector, long *error)
+{
+    assert(error);
+
+    if (disk_id < 1 || disk_id > MAX_NUMBER_OF_DISKS || sector < 0
+            || sector >= NUM_LOGICAL_SECTORS)
+    {
+        *error = ERR_BAD_PARAM;
+        return FALSE;
     }
+    *error = ERR_SUCCESS;
+    return TRUE;
+}
+
+/**
+ * Write a sector of a disk for the current process. Only the logical sectors
+ * can be written this way, the swap area is left to the pager.
+ * @param disk_id: Indicates which disk to write to.
+ * @param sector: Indicates which sector to write to.
+ * @param buffer: The data needs to be written.
+ * @param error: The error returned from the function.
+ */
+void os_user_disk_write(INT32 disk_id, INT32 sector, char *buffer, long *error)
+{
+    if (check_user_sector(disk_id, sector, error))
+        os_disk_write(disk_id, sector, buffer);
+}
+
+/**
+ * Read a sector of a disk for the current process. Only the logical sectors
+ * can be read this way, the swap area is left to the pager.
+ * @param disk_id: Indicates which disk to read from.
+ * @param sector: Indicates which sector to read from.
+ * @param buffer: The buffer to hold the data.
+ * @param error: The error returned from the function.
+ */
+void os_user_disk_read(INT32 disk_id, INT32 sector, char *buffer, long *error)
+{
+    if (check_user_sector(disk_id, sector, error))
+        os_disk_read(disk_id, sector, buffer);
 }
 
 /**
@@ -233,25 +1103,42 @@ void read_write_scheduler(INT32 device_id)
 {
     PCB *pcb;
     INT16 disk_id;
+    BOOL read_ahead;
 
-    switch (device_id)
+    if (device_id < DISK_INTERRUPT || device_id >= DISK_INTERRUPT + MAX_NUMBER_OF_DISKS)
     {
-        case 5:
-            disk_id = 1;
-            break;
-        case 6:
-            disk_id = 2;
-            break;
-        case 7:
-            disk_id = 3;
-            break;
-        default:
-            error_message("Illegal device id.");
-            break;
+        error_message("Illegal device id.");
+        return;
+    }
+    disk_id = (INT16) (device_id - DISK_INTERRUPT + 1);
+    get_data_lock(DISK_REGISTER_LOCK);
+
+    // Every interrupt completes exactly one request on that disk.
+    if (disk_load[disk_id] > 0)
+        disk_load[disk_id]--;
+
+    // A read ahead has filled its frame. The processes waiting for the page
+    // wait for the read as if they had started it.
+    read_ahead = read_ahead_frame[disk_id] >= 0;
+    if (read_ahead)
+    {
+        reading_ahead[read_ahead_frame[disk_id]] = FALSE;
+        read_ahead_frame[disk_id] = -1;
     }
 
-    pcb = remove_from_suspend_queue_by_disk_id(disk_id);
+    // Wake the process whose request has just completed, or every process
+    // waiting for the read ahead.
+    while ((pcb = remove_from_suspend_queue_by_disk_id(disk_id, TRUE)) != NULL)
+    {
+        add_to_ready_queue(pcb);
+        pcb->suspend = FALSE;
+        print_scheduling_info(ACTION_NAME_READY, pcb, NORMAL_INFO);
+        if (!read_ahead)
+            break;
+    }
 
+    // The disk is free again, so start the next request waiting for it.
+    pcb = remove_from_suspend_queue_by_disk_id(disk_id, FALSE);
     if (pcb != NULL)
     {
         // If the process needs to write, then write data to specific sector.
@@ -310,202 +1197,2901 @@ void read_write_scheduler(INT32 device_id)
                 print_scheduling_info(ACTION_NAME_READ, pcb, NORMAL_INFO);
             }
         }
-        else
+    }
+    release_data_lock(DISK_REGISTER_LOCK);
+}
+
+/**
+ * Find the page table entry of a virtual page of a process.
+ * @param pid: The process which owns the page.
+ * @param vpn: The virtual page number.
+ * @param create: Whether to allocate the second level table if it is missing.
+ * @return: The pointer to the entry, NULL if the page is out of the address
+ *          space of the process, or its table is missing and not created.
+ */
+static UINT32 *lookup_pte(INT32 pid, INT32 vpn, int create)
+{
+    int i;
+    INT32 dir_idx = vpn >> PTBL_LEAF_BITS;
+
+    if (vpn < 0 || dir_idx >= page_dir_length[pid])
+        return NULL;
+    if (!page_dir_holder[pid][dir_idx])
+    {
+        if (!create)
+            return NULL;
+        page_dir_holder[pid][dir_idx] = (UINT32 *) calloc(PTBL_LEAF_ENTRIES, sizeof (UINT32));
+        swap_dir_holder[pid][dir_idx] = (INT32 *) malloc(PTBL_LEAF_ENTRIES * sizeof (INT32));
+        if (!page_dir_holder[pid][dir_idx] || !swap_dir_holder[pid][dir_idx])
         {
-            add_to_ready_queue(pcb);
-            pcb->suspend = FALSE;
-            print_scheduling_info(ACTION_NAME_READY, pcb, NORMAL_INFO);
+            error_message("Page table allocation fails.");
+            shut_down();
         }
+        for (i = 0; i < PTBL_LEAF_ENTRIES; i++)
+            swap_dir_holder[pid][dir_idx][i] = NO_SWAP_SLOT;
     }
+    return &page_dir_holder[pid][dir_idx][vpn & (PTBL_LEAF_ENTRIES - 1)];
 }
 
 /**
- * Used in fault handler. Deal with the page fault and map the pages to the frames.
- * @param status: The virtual page number obtained from fault handler.
+ * Find the swap map entry of a virtual page, whose page table entry must exist.
+ * @param pid: The process which owns the page.
+ * @param vpn: The virtual page number.
+ * @return: The pointer to the swap slot of the page.
  */
-void frame_scheduler(INT32 status)
+static INT32 *lookup_swap_entry(INT32 pid, INT32 vpn)
 {
-    int pid;
-    int disk_id;
-    INT16 offset;
-    INT32 Index = 0;
-    INT16 available_frame;
-    offset = Z502_REG3 % PGSIZE;
-    disk_id = CurrentPCB->pid + 1;
+    return &swap_dir_holder[pid][vpn >> PTBL_LEAF_BITS][vpn & (PTBL_LEAF_ENTRIES - 1)];
+}
+
+/**
+ * Find the shared area a virtual page of a process belongs to.
+ * @param pid: The process.
+ * @param vpn: The virtual page number.
+ * @param page: Returns the index of the page within the area.
+ * @return: The area, NULL if the page is private.
+ */
+static SharedArea *find_shared_area(INT32 pid, INT32 vpn, INT32 *page)
+{
+    int i;
+    SharedArea *area;
 
-    if (!Z502_PAGE_TBL_ADDR)
+    for (i = 0; i < MAX_NUMBER_OF_SHARED_AREAS; i++)
     {
-        Z502_PAGE_TBL_LENGTH = 1024;
-        Z502_PAGE_TBL_ADDR = (UINT16 *) calloc(Z502_PAGE_TBL_LENGTH, sizeof (UINT16));
-        address_holder[disk_id - 1] = Z502_PAGE_TBL_ADDR;
+        area = &shared_areas[i];
+        if (!area->pages || area->start_vpn[pid] < 0)
+            continue;
+        if (vpn >= area->start_vpn[pid] && vpn < area->start_vpn[pid] + area->pages)
+        {
+            *page = vpn - area->start_vpn[pid];
+            return area;
+        }
     }
+    return NULL;
+}
+
+/**
+ * Find the disk map a virtual page of a process belongs to.
+ * @param pid: The process.
+ * @param vpn: The virtual page number.
+ * @param sector: Returns the sector which backs the page.
+ * @return: The disk map, NULL if the page is not mapped from a disk.
+ */
+static DiskMap *find_disk_map(INT32 pid, INT32 vpn, INT32 *sector)
+{
+    int i;
+    DiskMap *map;
 
-    // If page is invalid and not in the disk.
-    if (!(Z502_PAGE_TBL_ADDR[status] & PTBL_VALID_BIT))
+    for (i = 0; i < disk_map_count[pid]; i++)
     {
-        if (!(Z502_PAGE_TBL_ADDR[status] & PTBL_RESERVED_BIT))
+        map = &disk_maps[pid][i];
+        if (vpn >= map->start_vpn && vpn < map->start_vpn + map->pages)
         {
-            available_frame = get_frame_number_of_removed_frame();
-            if (available_frame >= 0)
-            {
-                Z502_PAGE_TBL_ADDR[status] = available_frame | PTBL_VALID_BIT;
-                shadow_pg_idx++;
-                shadow_pg_tbl[shadow_pg_idx] = &Z502_PAGE_TBL_ADDR[status];
-                process_holder[shadow_pg_idx] = disk_id - 1;
-            }
-            else
-            {
-                for (;;)
-                {
-                    ref_idx = (ref_idx + 1) % PHYS_MEM_PGS;
-                    ref_idx++;
-                    if (*shadow_pg_tbl[ref_idx] & PTBL_REFERENCED_BIT)
-                    {
-                        *shadow_pg_tbl[ref_idx] &= ~PTBL_REFERENCED_BIT;
-                    }
-                    else
-                    {
-                        short frame_number;
-                        frame_number = (short) (*shadow_pg_tbl[ref_idx]) & PTBL_FRAME_BITS;
-                        write_to_memory(Z502InterruptClear, &Index);
-                        pid = process_holder[ref_idx];
-                        os_disk_write(pid + 1, shadow_pg_tbl[ref_idx] - address_holder[pid],
-                                      (char *) &MEMORY[frame_number * PGSIZE]);
-                        *shadow_pg_tbl[ref_idx] |= PTBL_RESERVED_BIT;
-                        *shadow_pg_tbl[ref_idx] &= ~PTBL_VALID_BIT;
-                        Z502_PAGE_TBL_ADDR[status] = frame_number | PTBL_VALID_BIT;
-                        shadow_pg_tbl[ref_idx] = &Z502_PAGE_TBL_ADDR[status];
-                        process_holder[ref_idx] = disk_id - 1;
-                        break;
-                    }
-                }
-            }
+            *sector = map->start_sector + vpn - map->start_vpn;
+            return map;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find the handler of the faults on a virtual page of a process.
+ * @param pid: The process.
+ * @param vpn: The virtual page number.
+ * @return: The pid of the handler, -1 if the page is left to the pager.
+ */
+static INT32 find_userfault_handler(INT32 pid, INT32 vpn)
+{
+    int i;
+    UserfaultRange *range;
+
+    for (i = 0; i < userfault_count[pid]; i++)
+    {
+        range = &userfault_ranges[pid][i];
+        if (vpn >= range->start_vpn && vpn < range->start_vpn + range->pages)
+            return range->handler;
+    }
+    return -1;
+}
+
+/**
+ * Find the advice a process gave for one of its pages.
+ * @param pid: The process.
+ * @param vpn: The virtual page number.
+ * @return: The advice of the newest range holding the page, ADVICE_NORMAL
+ * if there is none.
+ */
+static INT32 advice_at(INT32 pid, INT32 vpn)
+{
+    int i;
+    AdviceRange *range;
+
+    for (i = advice_count[pid] - 1; i >= 0; i--)
+    {
+        range = &advice_ranges[pid][i];
+        if (vpn >= range->start_vpn && vpn < range->start_vpn + range->pages)
+            return range->advice;
+    }
+    return ADVICE_NORMAL;
+}
+
+/**
+ * Find the swap map entry of the page held by a frame, which for a shared
+ * page is kept by its area.
+ * @param frame_number: The frame.
+ * @return: The pointer to the swap slot of the page.
+ */
+static INT32 *frame_swap_entry(INT16 frame_number)
+{
+    SharedArea *area;
+    INT32 pid = process_holder[frame_number];
+
+    if (shared_area_of[frame_number] < 0)
+        return lookup_swap_entry(pid, vpn_holder[frame_number]);
+    area = &shared_areas[shared_area_of[frame_number]];
+    return &area->swap[vpn_holder[frame_number] - area->start_vpn[pid]];
+}
+
+/**
+ * Bring the entry of a shared page up to date with the page tables of its
+ * mappers: the referenced and modified bits the hardware set in any of them
+ * are collected, then the given bits are cleared in all of them.
+ * @param frame_number: The shared frame.
+ * @param clear_bits: The bits to clear, PTBL_ALL_BITS unmaps the page from
+ * every mapper at once.
+ */
+static void sync_shared_frame(INT16 frame_number, UINT32 clear_bits)
+{
+    SharedArea *area = &shared_areas[shared_area_of[frame_number]];
+    INT32 page = vpn_holder[frame_number] - area->start_vpn[process_holder[frame_number]];
+    INT32 pid;
+    UINT32 *pte;
+
+    for (pid = 0; pid < MAX_NUMBER_OF_USER_PROCESSES; pid++)
+    {
+        if (area->start_vpn[pid] < 0)
+            continue;
+        pte = lookup_pte(pid, area->start_vpn[pid] + page, FALSE);
+        if (!pte || !(*pte & PTBL_VALID_BIT) || (*pte & PTBL_FRAME_BITS) != frame_number)
+            continue;
+        *shadow_pg_tbl[frame_number] |= *pte & (PTBL_REFERENCED_BIT | PTBL_MODIFIED_BIT);
+        *pte &= ~clear_bits;
+    }
+    if (clear_bits == PTBL_ALL_BITS)
+        frame_mappers[frame_number] = 0;
+}
+
+/**
+ * Find a process other than the owner which maps a frame copy-on-write.
+ * The copies of a page are at the same virtual page in every process.
+ * @param frame_number: The frame.
+ * @return: The pid of the process, -1 if the owner is the only mapper left.
+ */
+static INT32 find_cow_sharer(INT16 frame_number)
+{
+    INT32 pid;
+    UINT32 *pte;
+
+    for (pid = 0; pid < MAX_NUMBER_OF_USER_PROCESSES; pid++)
+    {
+        if (pid == process_holder[frame_number] || !page_dir_holder[pid])
+            continue;
+        pte = lookup_pte(pid, vpn_holder[frame_number], FALSE);
+        if (pte && (*pte & PTBL_VALID_BIT) && (*pte & PTBL_PROTECTED_BIT)
+                && (*pte & PTBL_FRAME_BITS) == frame_number)
+            return pid;
+    }
+    return -1;
+}
+
+/**
+ * Collect the referenced bits the hardware set in the entries of the
+ * processes mapping a frame copy-on-write into the entry of its owner.
+ * @param frame_number: The frame.
+ */
+static void sync_cow_frame(INT16 frame_number)
+{
+    INT32 pid;
+    UINT32 *pte;
+
+    for (pid = 0; pid < MAX_NUMBER_OF_USER_PROCESSES; pid++)
+    {
+        if (pid == process_holder[frame_number] || !page_dir_holder[pid])
+            continue;
+        pte = lookup_pte(pid, vpn_holder[frame_number], FALSE);
+        if (!pte || (*pte & PTBL_FRAME_BITS) != frame_number
+                || (*pte & (PTBL_VALID_BIT | PTBL_PROTECTED_BIT)) != (PTBL_VALID_BIT | PTBL_PROTECTED_BIT))
+            continue;
+        *shadow_pg_tbl[frame_number] |= *pte & PTBL_REFERENCED_BIT;
+        *pte &= ~PTBL_REFERENCED_BIT;
+    }
+}
+
+/**
+ * Unmap a frame from the processes sharing it copy-on-write when the page of
+ * its owner leaves memory. They are left in the same state as the owner, and
+ * share its swap slot.
+ * @param frame_number: The frame.
+ * @param new_pte: The entry of the owner after the eviction, not valid.
+ * @param slot: The swap slot of the owner, NO_SWAP_SLOT if it has none.
+ */
+static void unshare_cow_frame(INT16 frame_number, UINT32 new_pte, INT32 slot)
+{
+    INT32 pid;
+    INT32 *entry;
+
+    while ((pid = find_cow_sharer(frame_number)) >= 0)
+    {
+        *lookup_pte(pid, vpn_holder[frame_number], FALSE) = new_pte;
+        entry = lookup_swap_entry(pid, vpn_holder[frame_number]);
+        release_swap_slot(*entry);
+        *entry = slot;
+        share_swap_slot(slot);
+    }
+}
+
+/**
+ * Attach a frame to the page table entry of a virtual page.
+ * @param frame_number: The frame which holds the page.
+ * @param pid: The process which owns the page.
+ * @param vpn: The virtual page number.
+ * @param pte: The page table entry of the page.
+ */
+static void attach_frame(INT16 frame_number, INT32 pid, INT32 vpn, UINT32 *pte)
+{
+    shadow_pg_tbl[frame_number] = pte;
+    process_holder[frame_number] = pid;
+    vpn_holder[frame_number] = vpn;
+    frame_heat[frame_number] = 0;
+    clock_chances[frame_number] = 0;
+    written_back[frame_number] = FALSE;
+    resident_pages[pid]++;
+    wake_frame_waiters();
+}
+
+/**
+ * Detach a frame from the page it holds, leaving it without an owner.
+ * @param frame_number: The frame to detach.
+ */
+static void detach_frame(INT16 frame_number)
+{
+    shadow_pg_tbl[frame_number] = NULL;
+    resident_pages[process_holder[frame_number]]--;
+    shared_area_of[frame_number] = -1;
+    frame_mappers[frame_number] = 0;
+}
+
+/**
+ * Hand a frame shared copy-on-write over to another of its mappers, when
+ * the owner stops mapping it.
+ * @param frame_number: The frame.
+ * @param heir: The process which becomes the owner.
+ */
+static void hand_over_cow_frame(INT16 frame_number, INT32 heir)
+{
+    resident_pages[process_holder[frame_number]]--;
+    resident_pages[heir]++;
+    process_holder[frame_number] = (UINT16) heir;
+    shadow_pg_tbl[frame_number] = lookup_pte(heir, vpn_holder[frame_number], FALSE);
+}
+
+/**
+ * The number of frames a process may hold before it has to replace its
+ * own pages: its working set target, capped by its quota if it has one.
+ * @param pid: The process.
+ * @return: The number of frames.
+ */
+static INT32 frame_limit(INT32 pid)
+{
+    if (frame_quota[pid] > 0 && frame_quota[pid] < frame_target[pid])
+        return frame_quota[pid];
+    return frame_target[pid];
+}
+
+/**
+ * Tell whether a process holds as many frames as its quota allows. Unlike
+ * the working set target, a quota is hard: such a process replaces one of
+ * its own pages for a new one even when free frames are left.
+ * @param pid: The process.
+ * @return: TRUE if the process is at its quota.
+ */
+static BOOL at_frame_quota(INT32 pid)
+{
+    return frame_quota[pid] > 0 && resident_pages[pid] >= frame_quota[pid];
+}
+
+/**
+ * Adjust the working set target of a process by its page fault frequency.
+ * Faulting again soon after the last fault means the resident set is too
+ * small, a long quiet interval means it can give frames back. The targets
+ * of all processes together never exceed physical memory. Once they are all
+ * given out, a growing process takes one from the process which has been
+ * quiet the longest, or else from the largest target, so the processes
+ * which keep faulting end up with even shares.
+ * @param pid: The process which faulted.
+ */
+static void adjust_frame_target(INT32 pid)
+{
+    INT32 now = get_current_time();
+    INT32 interval = now - last_fault_time[pid];
+    INT32 quiet = -1;
+    INT32 largest = pid;
+    INT32 i;
+
+    last_fault_time[pid] = now;
+    if (interval < WORKING_SET_GROW_INTERVAL && total_frame_target < ALL_MEM_PGS)
+    {
+        frame_target[pid]++;
+        total_frame_target++;
+    }
+    else if (interval < WORKING_SET_GROW_INTERVAL)
+    {
+        for (i = 0; i < MAX_NUMBER_OF_USER_PROCESSES; i++)
+        {
+            if (i == pid || frame_target[i] <= WORKING_SET_MIN_FRAMES)
+                continue;
+            if (now - last_fault_time[i] > WORKING_SET_SHRINK_INTERVAL
+                    && (quiet < 0 || last_fault_time[i] < last_fault_time[quiet]))
+                quiet = i;
+            if (frame_target[i] > frame_target[largest])
+                largest = i;
+        }
+        if (quiet < 0 && frame_target[largest] > frame_target[pid] + 1)
+            quiet = largest;
+        if (quiet >= 0)
+        {
+            frame_target[quiet]--;
+            frame_target[pid]++;
+        }
+    }
+    else if (interval > WORKING_SET_SHRINK_INTERVAL
+            && frame_target[pid] > WORKING_SET_MIN_FRAMES)
+    {
+        frame_target[pid]--;
+        total_frame_target--;
+    }
+}
+
+/**
+ * Find the least important priority among the processes holding frames,
+ * the one the pages of the others are weighted against.
+ * @return: The priority, -1 if no process holds a frame.
+ */
+static INT32 lowest_resident_priority(void)
+{
+    INT32 lowest = -1;
+    INT32 pid;
+
+    for (pid = 0; pid < MAX_NUMBER_OF_USER_PROCESSES; pid++)
+        if (resident_pages[pid] > 0 && ProcessTable[pid] && ProcessTable[pid]->priority > lowest)
+            lowest = ProcessTable[pid]->priority;
+    return lowest;
+}
+
+/**
+ * The number of extra sweeps of the clock an unreferenced page of a process
+ * survives for the priority of the process.
+ * @param pid: The process.
+ * @param lowest: The least important priority holding frames.
+ * @return: The number of sweeps, 0 without priority-aware replacement.
+ */
+static INT32 priority_weight(INT32 pid, INT32 lowest)
+{
+    INT32 weight;
+
+    if (!PRIORITY_REPLACEMENT || !ProcessTable[pid] || lowest < 0)
+        return 0;
+    weight = (lowest - ProcessTable[pid]->priority) / PRIORITY_WEIGHT_STEP;
+    return weight < PRIORITY_MAX_EXTRA_SWEEPS ? weight : PRIORITY_MAX_EXTRA_SWEEPS;
+}
+
+/**
+ * Tell whether the frames of a process are kept from other processes,
+ * because it is important enough and down to its minimum resident set.
+ * @param pid: The process.
+ * @return: TRUE if the frames of the process are protected.
+ */
+static BOOL is_priority_protected(INT32 pid)
+{
+    return PRIORITY_REPLACEMENT && ProcessTable[pid]
+            && ProcessTable[pid]->priority <= PRIORITY_PROTECTED_LEVEL
+            && resident_pages[pid] <= PRIORITY_MIN_RESIDENT;
+}
+
+/**
+ * Run the clock over the frames and pick one whose page has not been referenced
+ * since the last sweep. Frames which are in transit (no owner) are skipped.
+ * The slow tier is swept first, a page of the fast tier is only evicted when
+ * every page of the slow tier was referenced. With priority-aware
+ * replacement, an unreferenced page of an important process is passed by
+ * for a few more sweeps, see priority_weight().
+ * @param pid: Only consider frames of this process, -1 to consider the frames
+ * of every process holding more than its frame limit, -2 to consider all but
+ * the protected ones, see is_priority_protected(), -3 to consider all.
+ * @return: The number of the victim frame, -1 if no frame is in scope.
+ */
+static INT16 run_clock(INT32 pid)
+{
+    INT32 owner;
+    INT32 lowest = lowest_resident_priority();
+    INT32 sweeps = 0;
+    int steps;
+
+    for (owner = 0; owner < MAX_NUMBER_OF_USER_PROCESSES; owner++)
+        if (resident_pages[owner] > 0 && priority_weight(owner, lowest) > sweeps)
+            sweeps = priority_weight(owner, lowest);
+    // Two sweeps per tier are enough, the first one clears every referenced
+    // bit, and one more for each extra sweep a page may survive.
+    sweeps += 2;
+    for (steps = 0; steps < 2 * sweeps * ALL_MEM_PGS; steps++)
+    {
+        ref_idx = (ref_idx + 1) % ALL_MEM_PGS;
+        if (shadow_pg_tbl[ref_idx] == NULL || writing_back[ref_idx] || reading_ahead[ref_idx]
+                || inactive[ref_idx])
+            continue;
+        if (steps < sweeps * ALL_MEM_PGS && is_fast_frame(ref_idx))
+            continue;
+        owner = process_holder[ref_idx];
+        if ((pid >= 0 && owner != pid)
+                || (pid == -1 && resident_pages[owner] <= frame_limit(owner)))
+            continue;
+        if ((pid == -1 || pid == -2) && is_priority_protected(owner))
+            continue;
+        if (shared_area_of[ref_idx] >= 0)
+            sync_shared_frame(ref_idx, PTBL_REFERENCED_BIT);
+        else if (*shadow_pg_tbl[ref_idx] & PTBL_PROTECTED_BIT)
+            sync_cow_frame(ref_idx);
+        // The tier scan may have moved the referenced bit into the heat.
+        if ((*shadow_pg_tbl[ref_idx] & PTBL_REFERENCED_BIT) || (frame_heat[ref_idx] & FRAME_HEAT_RECENT))
+        {
+            *shadow_pg_tbl[ref_idx] &= ~PTBL_REFERENCED_BIT;
+            frame_heat[ref_idx] &= ~FRAME_HEAT_RECENT;
+            clock_chances[ref_idx] = (char) priority_weight(owner, lowest);
+        }
+        else if (clock_chances[ref_idx] > 0)
+        {
+            clock_chances[ref_idx]--;
+            priority_spared++;
         }
         else
+            return (INT16) ref_idx;
+    }
+    return -1;
+}
+
+/**
+ * Pick the frame to evict for a fault of a process. A process at its frame
+ * limit replaces its own pages. Otherwise frames are taken from processes
+ * above their limit first, then from anybody but the protected resident
+ * sets of important processes, and only then from anybody. A process at its
+ * quota never takes a frame of another process.
+ * @param pid: The process which needs a frame.
+ * @return: The number of the victim frame, -1 if every frame in scope is
+ * inactive or in flight.
+ */
+static INT16 select_victim_frame(INT32 pid)
+{
+    INT16 frame_number = -1;
+
+    if (resident_pages[pid] >= frame_limit(pid))
+        frame_number = run_clock(pid);
+    if (frame_number >= 0)
+    {
+        local_evictions++;
+        return frame_number;
+    }
+    if (at_frame_quota(pid))
+        return -1;
+    frame_number = run_clock(-1);
+    if (frame_number < 0)
+        frame_number = run_clock(-2);
+    if (frame_number < 0)
+        frame_number = run_clock(-3);
+    if (frame_number >= 0)
+        global_evictions++;
+    return frame_number;
+}
+
+/**
+ * Write the page held by a frame out to a freshly allocated swap slot,
+ * and record the slot in the swap map of the owning process. A page which
+ * is unmodified since it came from its slot needs no write at all.
+ * While the write is pending, the frame is kept in the swap cache, so
+ * the owner faulting on the page takes it back instead of reading a
+ * slot which has not been written yet.
+ * @param frame_number: The frame to write back.
+ * @return: TRUE if the page is in its slot and the frame still caches it,
+ * FALSE if the owner took the page back during the write.
+ */
+static BOOL write_back(INT16 frame_number)
+{
+    INT32 Index = 0;
+    INT32 slot;
+    INT32 sector;
+    INT32 *entry = frame_swap_entry(frame_number);
+    UINT32 *pte = shadow_pg_tbl[frame_number];
+    DiskMap *map = find_disk_map(process_holder[frame_number], vpn_holder[frame_number], &sector);
+
+    *pte |= PTBL_RESERVED_BIT;
+    *pte &= ~PTBL_VALID_BIT;
+    written_back[frame_number] = FALSE;
+    if ((map || *entry != NO_SWAP_SLOT) && !(*pte & PTBL_MODIFIED_BIT))
+    {
+        swap_cache[frame_number] = TRUE;
+        return TRUE;
+    }
+    // A page mapped from a disk goes back to its own sector.
+    if (!map)
+    {
+        release_swap_slot(*entry);
+        *entry = NO_SWAP_SLOT;
+
+        slot = allocate_swap_slot();
+        if (slot == NO_SWAP_SLOT)
         {
-            available_frame = get_frame_number_of_removed_frame();
-            if (available_frame >= 0)
-            {
-                os_disk_read(disk_id, status, (char *) &MEMORY[available_frame * PGSIZE]);
-                Z502_PAGE_TBL_ADDR[status] = available_frame | PTBL_VALID_BIT;
-                shadow_pg_idx++;
-                shadow_pg_tbl[shadow_pg_idx] = &Z502_PAGE_TBL_ADDR[status];
-                process_holder[shadow_pg_idx] = disk_id - 1;
-            }
-            else
-            {
-                for (;;)
-                {
-                    ref_idx = (ref_idx + 1) % PHYS_MEM_PGS;
-                    ref_idx++;
-                    if (*shadow_pg_tbl[ref_idx] & PTBL_REFERENCED_BIT)
-                    {
-                        *shadow_pg_tbl[ref_idx] &= ~PTBL_REFERENCED_BIT;
-                    }
-                    else
-                    {
-                        // Choose this as victim.
-                        short frame_number;
-                        frame_number = (short) (*shadow_pg_tbl[ref_idx]) & PTBL_FRAME_BITS;
-                        write_to_memory(Z502InterruptClear, &Index);
-                        pid = process_holder[ref_idx];
-                        os_disk_write(pid + 1, shadow_pg_tbl[ref_idx] - address_holder[pid],
-                                      (char *) &MEMORY[frame_number * PGSIZE]);
-                        (*shadow_pg_tbl[ref_idx]) |= PTBL_RESERVED_BIT;
-                        (*shadow_pg_tbl[ref_idx]) &= ~PTBL_VALID_BIT;
-                        os_disk_read(disk_id, status, (char *) &MEMORY[frame_number * PGSIZE]);
-                        Z502_PAGE_TBL_ADDR[status] = frame_number | PTBL_VALID_BIT;
-                        shadow_pg_tbl[ref_idx] = &Z502_PAGE_TBL_ADDR[status];
-                        process_holder[ref_idx] = disk_id - 1;
-                        break;
-                    }
-                }
-            }
+            error_message("Swap space is exhausted.");
+            shut_down();
         }
+        *entry = slot;
+        compressed_owner[slot] = process_holder[frame_number];
+    }
+
+    swap_cache[frame_number] = TRUE;
+    writing_back[frame_number] = TRUE;
+    written_back[frame_number] = TRUE;
+    if (map)
+    {
+        count_page_out(process_holder[frame_number]);
+        write_to_memory(Z502InterruptClear, &Index);
+        os_disk_write(map->disk_id, sector, (char *) &MEMORY[frame_number * PGSIZE]);
+        disk_map_writes++;
+    }
+    else if (!compress_page(slot, &MEMORY[frame_number * PGSIZE]))
+    {
+        count_page_out(process_holder[frame_number]);
+        write_to_memory(Z502InterruptClear, &Index);
+        os_disk_write(swap_slot_disk(slot), swap_slot_sector(slot),
+                      (char *) &MEMORY[frame_number * PGSIZE]);
     }
+    writing_back[frame_number] = FALSE;
+    wake_frame_waiters();
+    return swap_cache[frame_number] && shadow_pg_tbl[frame_number] == pte;
+}
+
+/**
+ * Evict the page held by a frame. A page in the swap cache is simply
+ * dropped, an unmodified new page goes back to the untouched state, any
+ * other page is written back first.
+ * @param frame_number: The frame to evict.
+ * @return: TRUE if the frame is free now, FALSE if the owner took the
+ * page back during the write and another victim has to be chosen.
+ */
+static BOOL page_out(INT16 frame_number)
+{
+    INT32 tlb_frame;
+    INT32 slot;
+    int pid;
+    UINT32 *pte;
 
-    // If next page is also invalid and not in the disk.
-    if (!(Z502_PAGE_TBL_ADDR[status + 1] & PTBL_VALID_BIT) && (offset > PGSIZE - 4))
+    pte = shadow_pg_tbl[frame_number];
+    pid = process_holder[frame_number];
+    tlb_frame = frame_number;
+    write_to_memory(Z502TLBInvalidate, &tlb_frame);
+    if (shared_area_of[frame_number] >= 0)
+        sync_shared_frame(frame_number, PTBL_ALL_BITS);
+
+    // A page read ahead or deactivated is still in its swap slot, or its sector.
+    slot = *frame_swap_entry(frame_number);
+    if (swap_cache[frame_number])
     {
-        if (!(Z502_PAGE_TBL_ADDR[status + 1] & PTBL_RESERVED_BIT))
+        if (inactive[frame_number])
         {
-            available_frame = get_frame_number_of_removed_frame();
-            if (available_frame >= 0)
-            {
-                Z502_PAGE_TBL_ADDR[status + 1] = available_frame | PTBL_VALID_BIT;
-                shadow_pg_idx++;
-                shadow_pg_tbl[shadow_pg_idx] = &Z502_PAGE_TBL_ADDR[status + 1];
-                process_holder[shadow_pg_idx] = disk_id - 1;
-            }
-            else
-            {
-                for (;;)
-                {
-                    ref_idx = (ref_idx + 1) % PHYS_MEM_PGS;
-                    ref_idx++;
-                    if ((*shadow_pg_tbl[ref_idx]) & PTBL_REFERENCED_BIT)
-                    {
-                        *shadow_pg_tbl[ref_idx] &= ~PTBL_REFERENCED_BIT;
-                    }
-                    else
-                    {
-                        short frame_number;
-                        frame_number = (short) (*shadow_pg_tbl[ref_idx]) & PTBL_FRAME_BITS;
-                        write_to_memory(Z502InterruptClear, &Index);
-                        pid = process_holder[ref_idx];
-                        os_disk_write(pid + 1, shadow_pg_tbl[ref_idx] - address_holder[pid],
-                                      (char *) &MEMORY[frame_number * PGSIZE]);
-                        (*shadow_pg_tbl[ref_idx]) |= PTBL_RESERVED_BIT;
-                        (*shadow_pg_tbl[ref_idx]) &= ~PTBL_VALID_BIT;
-                        Z502_PAGE_TBL_ADDR[status + 1] = frame_number | PTBL_VALID_BIT;
-                        shadow_pg_tbl[ref_idx] = &Z502_PAGE_TBL_ADDR[status + 1];
-                        process_holder[ref_idx] = disk_id - 1;
-                        break;
-                    }
-                }
-            }
+            inactive[frame_number] = FALSE;
+            inactive_count--;
+            if (slot != NO_SWAP_SLOT)
+                slot_evicted_at[slot] = inactive_since[frame_number];
         }
         else
         {
-            // In the disk.
-            available_frame = get_frame_number_of_removed_frame();
-            if (available_frame >= 0) // Have a free frame.
-            {
-                write_to_memory(Z502InterruptClear, &Index);
-                os_disk_read(disk_id, status + 1, (char *) &MEMORY[available_frame * PGSIZE]);
-                Z502_PAGE_TBL_ADDR[status + 1] = available_frame | PTBL_VALID_BIT;
-                shadow_pg_idx++;
-                shadow_pg_tbl[shadow_pg_idx] = &Z502_PAGE_TBL_ADDR[status + 1];
-                process_holder[shadow_pg_idx] = disk_id - 1;
-            }
-            else // No more free frame.
-            {
-                for (;;)
-                {
-                    ref_idx = (ref_idx + 1) % PHYS_MEM_PGS;
-                    ref_idx++;
-                    if (*shadow_pg_tbl[ref_idx] & PTBL_REFERENCED_BIT)
-                    {
-                        // Set the bit as zero;
-                        *shadow_pg_tbl[ref_idx] &= ~PTBL_REFERENCED_BIT;
-                    }
-                    else
-                    {
-                        short frame_number;
-                        frame_number = (short) (*shadow_pg_tbl[ref_idx]) & PTBL_FRAME_BITS;
-                        write_to_memory(Z502InterruptClear, &Index);
-                        pid = process_holder[ref_idx];
-                        os_disk_write(pid + 1, shadow_pg_tbl[ref_idx] - address_holder[pid], (char *) &MEMORY[frame_number * PGSIZE]);
-                        (*shadow_pg_tbl[ref_idx]) |= PTBL_RESERVED_BIT;
-                        (*shadow_pg_tbl[ref_idx]) &= ~PTBL_VALID_BIT;
-                        os_disk_read(disk_id, status + 1, (char *) &MEMORY[frame_number * PGSIZE]);
-                        Z502_PAGE_TBL_ADDR[status + 1] = frame_number | PTBL_VALID_BIT;
-                        shadow_pg_tbl[ref_idx] = &Z502_PAGE_TBL_ADDR[status + 1];
-                        process_holder[ref_idx] = disk_id - 1;
-                        break;
-                    }
-                }
-            }
+            read_ahead_wasted++;
+            if (read_ahead_window[pid] > READ_AHEAD_MIN_WINDOW)
+                read_ahead_window[pid] /= 2;
+        }
+        count_eviction(frame_number);
+        detach_frame(frame_number);
+        swap_cache[frame_number] = FALSE;
+        return TRUE;
+    }
+    // An unmodified new page goes back to the untouched state, no write needed.
+    if (fresh_frame[frame_number] && !(*pte & PTBL_MODIFIED_BIT))
+    {
+        if (*pte & PTBL_PROTECTED_BIT)
+            unshare_cow_frame(frame_number, 0, NO_SWAP_SLOT);
+        count_eviction(frame_number);
+        detach_frame(frame_number);
+        fresh_frame[frame_number] = FALSE;
+        *pte = 0;
+        return TRUE;
+    }
+    fresh_frame[frame_number] = FALSE;
+
+    if (!write_back(frame_number))
+        return FALSE;
+    slot = *frame_swap_entry(frame_number);
+    if (*pte & PTBL_PROTECTED_BIT)
+        unshare_cow_frame(frame_number, PTBL_RESERVED_BIT, slot);
+    if (slot != NO_SWAP_SLOT)
+        slot_evicted_at[slot] = deactivations;
+    swap_cache[frame_number] = FALSE;
+    count_eviction(frame_number);
+    detach_frame(frame_number);
+    return TRUE;
+}
+
+/**
+ * Move a frame to the inactive list. Its page is unmapped and written back,
+ * but the frame keeps it in the swap cache, so a refault before the frame is
+ * reclaimed maps it again without any I/O. An unmodified new page has nothing
+ * to keep and its frame is freed right away.
+ * @param frame_number: The frame to deactivate.
+ */
+static void deactivate_frame(INT16 frame_number)
+{
+    INT32 tlb_frame = frame_number;
+    UINT32 *pte = shadow_pg_tbl[frame_number];
+
+    write_to_memory(Z502TLBInvalidate, &tlb_frame);
+    if (shared_area_of[frame_number] >= 0)
+        sync_shared_frame(frame_number, PTBL_ALL_BITS);
+    if (fresh_frame[frame_number] && !(*pte & PTBL_MODIFIED_BIT))
+    {
+        if (*pte & PTBL_PROTECTED_BIT)
+            unshare_cow_frame(frame_number, 0, NO_SWAP_SLOT);
+        count_eviction(frame_number);
+        detach_frame(frame_number);
+        fresh_frame[frame_number] = FALSE;
+        *pte = 0;
+        add_to_frame_queue(frame_number);
+        return;
+    }
+    fresh_frame[frame_number] = FALSE;
+
+    if (!swap_cache[frame_number] && !write_back(frame_number))
+        return;
+    if (*pte & PTBL_PROTECTED_BIT)
+        unshare_cow_frame(frame_number, PTBL_RESERVED_BIT, *frame_swap_entry(frame_number));
+    inactive[frame_number] = TRUE;
+    inactive_since[frame_number] = deactivations++;
+    inactive_count++;
+}
+
+/**
+ * Wait until the read ahead into a frame is done. The current process waits
+ * on the disk as if it had started the read, so the interrupt of the read
+ * wakes it. Nothing happens if the read is done already.
+ * @param frame_number: The frame being read into.
+ */
+static void wait_for_read_ahead(INT16 frame_number)
+{
+    INT32 disk_id;
+    int result;
+
+    get_data_lock(DISK_REGISTER_LOCK);
+    for (disk_id = 1; disk_id <= MAX_NUMBER_OF_DISKS; disk_id++)
+        if (read_ahead_frame[disk_id] == frame_number)
+            break;
+    if (disk_id > MAX_NUMBER_OF_DISKS)
+    {
+        release_data_lock(DISK_REGISTER_LOCK);
+        return;
+    }
+    read_ahead_waits++;
+    CurrentPCB->disk_id = disk_id;
+    CurrentPCB->operation = -1;
+    get_data_lock(SUSPEND_QUEUE_LOCK);
+    result = add_to_suspend_queue(CurrentPCB);
+    release_data_lock(SUSPEND_QUEUE_LOCK);
+    release_data_lock(DISK_REGISTER_LOCK);
+    if (result)
+    {
+        CurrentPCB->suspend = TRUE;
+        print_scheduling_info(ACTION_NAME_READ, CurrentPCB, NORMAL_INFO);
+    }
+    else
+    {
+        error_message("add_to_suspend_queue");
+        shut_down();
+    }
+    CurrentPCB->in_disk_io = TRUE;
+    os_dispatcher();
+    CurrentPCB->in_disk_io = FALSE;
+}
+
+/**
+ * Wait until there may be a frame to take again, when every frame is in
+ * flight: being written back, read ahead, or between two pages. A read ahead
+ * is waited for on its disk, otherwise the process blocks until
+ * wake_frame_waiters() is called. A process swapped out by load control
+ * only finishes its write back once it runs again, so the swapped processes
+ * are let back in first.
+ * @param pid: The process which needs a frame, the current one.
+ */
+static void wait_for_frame(INT32 pid)
+{
+    INT16 frame_number;
+
+    paging_stats[pid].frame_waits++;
+    system_paging_stats.frame_waits++;
+    for (frame_number = 0; frame_number < ALL_MEM_PGS; frame_number++)
+        if (reading_ahead[frame_number])
+        {
+            wait_for_read_ahead(frame_number);
+            return;
+        }
+    while (swap_in_process())
+        load_swap_ins++;
+    frame_waiter[pid] = TRUE;
+    while (frame_waiter[pid])
+        os_block_process();
+}
+
+/**
+ * Find the frame which has been on the inactive list the longest. A process
+ * at its frame limit only reclaims its own inactive frames.
+ * @param pid: The process which needs a frame.
+ * @return: The number of the frame, -1 if there is none.
+ */
+static INT16 take_inactive_frame(INT32 pid)
+{
+    INT16 frame_number;
+    INT16 oldest = -1;
+    int local = resident_pages[pid] >= frame_limit(pid);
+
+    for (frame_number = 0; frame_number < ALL_MEM_PGS; frame_number++)
+    {
+        if (!inactive[frame_number] || (local && process_holder[frame_number] != pid))
+            continue;
+        if (oldest < 0 || inactive_since[frame_number] < inactive_since[oldest])
+            oldest = frame_number;
+    }
+    return oldest;
+}
+
+/**
+ * Reclaim a frame when there is no free one: the oldest inactive frame once
+ * the inactive list is full, otherwise the victim of the clock, so the list
+ * can fill up. When the clock finds every frame inactive or in flight, an
+ * inactive frame is taken anyway, or a frame freed meanwhile; with none of
+ * them, the process waits for the I/O in flight, see wait_for_frame().
+ * @param pid: The process which needs a frame.
+ * @return: The number of the frame, which is free now.
+ */
+static INT16 reclaim_frame(INT32 pid)
+{
+    INT16 frame_number = -1;
+
+    if (inactive_count >= INACTIVE_LIST_FRAMES)
+        frame_number = take_inactive_frame(pid);
+    if (frame_number >= 0 && page_out(frame_number))
+        return frame_number;
+    for (;;)
+    {
+        frame_number = select_victim_frame(pid);
+        if (frame_number < 0)
+            frame_number = take_inactive_frame(pid);
+        if (frame_number >= 0)
+        {
+            if (page_out(frame_number))
+                return frame_number;
+            continue;
+        }
+        if (!at_frame_quota(pid))
+        {
+            frame_number = get_frame_number_of_removed_frame();
+            if (frame_number < 0)
+                frame_number = get_frame_number_of_zeroed_frame();
+            if (frame_number >= 0)
+                return frame_number;
+        }
+        wait_for_frame(pid);
+    }
+}
+
+/**
+ * Keep the inactive list filled once memory is full, one frame per fault,
+ * so the cost of the write back is the one the fault would have paid anyway.
+ * The pages of the fault itself are not referenced before the access is
+ * retried, so the clock may pick them. They are left alone, otherwise
+ * the retry faults on them again, and does so forever in a small memory.
+ * @param pid: The process which faulted.
+ * @param vpn: The first page of the fault.
+ * @param last_vpn: The last page of the fault.
+ */
+static void refill_inactive_list(INT32 pid, INT32 vpn, INT32 last_vpn)
+{
+    INT16 frame_number;
+
+    if (FrameQueue->size || FastFrameQueue->size || ZeroFrameQueue->size
+            || inactive_count >= INACTIVE_LIST_FRAMES)
+        return;
+    frame_number = select_victim_frame(pid);
+    if (frame_number < 0)
+        return;
+    if (process_holder[frame_number] == pid && vpn_holder[frame_number] >= vpn
+            && vpn_holder[frame_number] <= last_vpn)
+        return;
+    deactivate_frame(frame_number);
+}
+
+/**
+ * Find the frame of the swap cache which holds a page.
+ * @param pte: The page table entry of the page.
+ * @return: The number of the frame, if the page is not cached, -1 is returned.
+ */
+static INT16 find_swap_cache_frame(UINT32 *pte)
+{
+    INT16 frame_number = (INT16) (*pte & PTBL_FRAME_BITS);
+
+    if (frame_number < ALL_MEM_PGS && swap_cache[frame_number]
+            && shadow_pg_tbl[frame_number] == pte)
+        return frame_number;
+    return -1;
+}
+
+/**
+ * Start a read into a frame without waiting for it. Only done when the disk
+ * is free, so the interrupt of the read does not belong to any process. The
+ * frame is marked as being filled until the interrupt.
+ * @param disk_id: Indicates which disk to read from.
+ * @param sector: Indicates which sector to read from.
+ * @param frame_number: The frame to read into.
+ * @return: The value indicates whether the read was started.
+ */
+static int start_read_ahead(INT32 disk_id, INT32 sector, INT16 frame_number)
+{
+    INT32 status;
+    char *buffer = &MEMORY[frame_number * PGSIZE];
+
+    get_data_lock(DISK_REGISTER_LOCK);
+    write_to_memory(Z502DiskSetID, &disk_id);
+    read_from_memory(Z502DiskStatus, &status);
+    if (status != DEVICE_FREE)
+    {
+        release_data_lock(DISK_REGISTER_LOCK);
+        return FALSE;
+    }
+
+    disk_load[disk_id]++;
+    disk_arm[disk_id] = sector;
+    reading_ahead[frame_number] = TRUE;
+    read_ahead_frame[disk_id] = frame_number;
+    write_to_memory(Z502DiskSetSector, &sector);
+    write_to_memory(Z502DiskSetBuffer, (INT32 *) buffer);
+    status = 0; // Specify a read
+    write_to_memory(Z502DiskSetAction, &status);
+    status = 0; // Must be set to 0
+    write_to_memory(Z502DiskStart, &status);
+    release_data_lock(DISK_REGISTER_LOCK);
+    return TRUE;
+}
+
+/**
+ * Wait until no read ahead is filling a frame of a process, so its frames
+ * can be freed. Called before its address space is torn down.
+ * @param pid: The process.
+ */
+void finish_read_ahead(INT32 pid)
+{
+    INT16 frame_number;
+
+    for (frame_number = 0; frame_number < ALL_MEM_PGS; frame_number++)
+        if (reading_ahead[frame_number] && shadow_pg_tbl[frame_number]
+                && process_holder[frame_number] == pid)
+            wait_for_read_ahead(frame_number);
+}
+
+/**
+ * Take a frame to read a page ahead into without paying a write: a free
+ * frame, a zeroed one, or the oldest inactive frame, whose page is on disk
+ * already. A process at its quota only gets one of its own inactive frames.
+ * @param pid: The process which reads ahead.
+ * @return: The number of the frame, -1 if only a dirty page could make room.
+ */
+static INT16 take_clean_frame(INT32 pid)
+{
+    INT16 frame_number = -1;
+
+    if (!at_frame_quota(pid))
+    {
+        frame_number = get_frame_number_of_removed_frame();
+        if (frame_number < 0)
+            frame_number = get_frame_number_of_zeroed_frame();
+    }
+    if (frame_number >= 0 || !inactive_count)
+        return frame_number;
+    frame_number = take_inactive_frame(pid);
+    if (frame_number >= 0 && page_out(frame_number))
+        return frame_number;
+    return -1;
+}
+
+/**
+ * Start reading a swapped-out or disk-mapped page of a process into the swap
+ * cache. A cached page stays invalid until the process touches it and keeps
+ * its swap slot or sector, so it can be dropped for free if it is never used.
+ * A page on a busy disk, or held by the compressed cache, is left alone, and
+ * so is any page when no frame is free or clean.
+ * @param pid: The process which owns the page.
+ * @param vpn: The virtual page number.
+ * @return: The value indicates whether a read was started.
+ */
+static BOOL prefetch_page(INT32 pid, INT32 vpn)
+{
+    INT32 slot;
+    INT32 disk_id;
+    INT32 sector;
+    INT16 frame_number;
+    DiskMap *map = find_disk_map(pid, vpn, &sector);
+    UINT32 *pte = lookup_pte(pid, vpn, map != NULL);
+
+    if (!pte || (*pte & PTBL_VALID_BIT) || (!(*pte & PTBL_RESERVED_BIT) && !map)
+            || find_swap_cache_frame(pte) >= 0)
+        return FALSE;
+    if (map && !sector_written[map->disk_id][sector])
+        return FALSE;
+    if (map)
+        disk_id = map->disk_id;
+    else
+    {
+        slot = *lookup_swap_entry(pid, vpn);
+        if (compressed_mask[slot] >= 0)
+            return FALSE;
+        disk_id = swap_slot_disk(slot);
+        sector = swap_slot_sector(slot);
+    }
+    if (disk_load[disk_id] > 0)
+        return FALSE;
+
+    frame_number = take_clean_frame(pid);
+    if (frame_number < 0)
+        return FALSE;
+    if (!start_read_ahead(disk_id, sector, frame_number))
+    {
+        add_to_frame_queue(frame_number);
+        return FALSE;
+    }
+
+    *pte = (*pte & ~(PTBL_FRAME_BITS | PTBL_REFERENCED_BIT)) | PTBL_RESERVED_BIT | frame_number;
+    attach_frame(frame_number, pid, vpn, pte);
+    swap_cache[frame_number] = TRUE;
+    count_page_in(pid);
+    return TRUE;
+}
+
+/**
+ * Read the next swapped-out pages along the fault stride of the current process
+ * into the swap cache, up to its read-ahead window.
+ * @param pid: The current process.
+ * @param vpn: The virtual page number which faulted.
+ * @param stride: The distance between the last two faults.
+ */
+static void read_ahead(INT32 pid, INT32 vpn, INT32 stride)
+{
+    int k;
+
+    for (k = 1; k <= read_ahead_window[pid]; k++)
+        if (prefetch_page(pid, vpn + k * stride))
+            read_ahead_issued++;
+}
+
+/**
+ * Drop the pages a process read sequentially a while ago, as it is not going
+ * to read them again soon. A clean page goes to the inactive list at once,
+ * a dirty one loses its referenced bit and heat, so the clock takes it next
+ * and the write back is not paid at the fault. Only private pages the
+ * process holds itself in a sequential range are dropped.
+ * @param pid: The current process.
+ * @param start: The first virtual page number to drop.
+ * @param pages: The number of pages to drop.
+ */
+static void drop_behind(INT32 pid, INT32 start, INT32 pages)
+{
+    INT32 vpn;
+    INT32 page;
+    INT16 frame_number;
+    UINT32 *pte;
+
+    for (vpn = start; vpn < start + pages; vpn++)
+    {
+        pte = lookup_pte(pid, vpn, FALSE);
+        if (!pte || !(*pte & PTBL_VALID_BIT) || (*pte & PTBL_PROTECTED_BIT)
+                || advice_at(pid, vpn) != ADVICE_SEQUENTIAL
+                || find_shared_area(pid, vpn, &page))
+            continue;
+        frame_number = (INT16) (*pte & PTBL_FRAME_BITS);
+        if (shadow_pg_tbl[frame_number] != pte || writing_back[frame_number])
+            continue;
+        if (!(*pte & PTBL_MODIFIED_BIT)
+                && (fresh_frame[frame_number] || *lookup_swap_entry(pid, vpn) != NO_SWAP_SLOT
+                    || find_disk_map(pid, vpn, &page)))
+            deactivate_frame(frame_number);
+        else
+        {
+            *pte &= ~PTBL_REFERENCED_BIT;
+            frame_heat[frame_number] = 0;
+        }
+        advice_dropped_behind++;
+    }
+}
+
+/**
+ * Map a page of the current process which is held by the swap cache.
+ * @param pid: The current process.
+ * @param frame_number: The frame of the swap cache which holds the page.
+ */
+static void map_cached_page(INT32 pid, INT16 frame_number)
+{
+    // A page still shared copy-on-write stays protected.
+    swap_cache[frame_number] = FALSE;
+    *shadow_pg_tbl[frame_number] = frame_number | PTBL_VALID_BIT
+            | (*shadow_pg_tbl[frame_number] & PTBL_PROTECTED_BIT);
+    if (inactive[frame_number])
+    {
+        inactive[frame_number] = FALSE;
+        inactive_count--;
+        inactive_refaults++;
+        inactive_refault_distance += deactivations - inactive_since[frame_number];
+        return;
+    }
+    // A page caught on its way out was not read ahead.
+    if (writing_back[frame_number])
+        return;
+    read_ahead_hits++;
+    if (read_ahead_window[pid] < READ_AHEAD_MAX_WINDOW)
+        read_ahead_window[pid] *= 2;
+}
+
+/**
+ * Bring a page into a frame, evicting another page if there is no free
+ * frame. If the page was swapped out, it is taken from the swap cache, or
+ * else its content is read back from the swap slot, which the page keeps
+ * while it is clean. A page mapped from a disk is read from its sector.
+ * A new page gets a frame from the zero pool, or one zeroed on the spot.
+ * @param pid: The current process.
+ * @param vpn: The virtual page number of the page in the current process.
+ * @param pte: The entry which holds the state of the page.
+ * @param entry: The swap map entry of the page.
+ * @return: The number of the frame which holds the page.
+ */
+static INT16 load_page(INT32 pid, INT32 vpn, UINT32 *pte, INT32 *entry)
+{
+    INT16 frame_number;
+    INT32 slot;
+    INT32 sector;
+    DiskMap *map;
+    int zeroed = FALSE;
+
+    // A page still being read ahead is mapped once the read is done. The
+    // frame may have been reclaimed by then.
+    frame_number = find_swap_cache_frame(pte);
+    while (frame_number >= 0 && reading_ahead[frame_number])
+    {
+        wait_for_read_ahead(frame_number);
+        frame_number = find_swap_cache_frame(pte);
+    }
+    if (frame_number >= 0)
+    {
+        map_cached_page(pid, frame_number);
+        return frame_number;
+    }
+
+    // A swapped-out or disk-mapped page is read over the frame, a new page
+    // needs it zeroed.
+    map = find_disk_map(pid, vpn, &sector);
+    if (at_frame_quota(pid))
+        frame_number = -1;
+    else if ((*pte & PTBL_RESERVED_BIT) || map)
+    {
+        frame_number = get_frame_number_of_removed_frame();
+        if (frame_number < 0)
+            frame_number = get_frame_number_of_zeroed_frame();
+    }
+    else
+    {
+        frame_number = get_frame_number_of_zeroed_frame();
+        zeroed = frame_number >= 0;
+        if (!zeroed)
+            frame_number = get_frame_number_of_removed_frame();
+    }
+    if (frame_number < 0)
+        frame_number = reclaim_frame(pid);
+
+    fresh_frame[frame_number] = !(*pte & PTBL_RESERVED_BIT) && !map;
+    if (zeroed)
+        zero_pool_hits++;
+    else if (fresh_frame[frame_number])
+    {
+        memset(&MEMORY[frame_number * PGSIZE], 0, PGSIZE);
+        zero_pool_misses++;
+    }
+    if (map && sector_written[map->disk_id][sector])
+    {
+        count_page_in(pid);
+        fault_major[pid] = TRUE;
+        os_disk_read(map->disk_id, sector, (char *) &MEMORY[frame_number * PGSIZE]);
+        disk_map_reads++;
+    }
+    else if (map)
+        memset(&MEMORY[frame_number * PGSIZE], 0, PGSIZE);
+    else if ((*pte & PTBL_RESERVED_BIT) && decompress_page(*entry, &MEMORY[frame_number * PGSIZE]))
+    {
+        // Once nobody else shares the slot, the cache need not keep the page.
+        compressed_hits++;
+        if (swap_slot_refs[*entry] == 1)
+        {
+            release_swap_slot(*entry);
+            *entry = NO_SWAP_SLOT;
+        }
+    }
+    else if (*pte & PTBL_RESERVED_BIT)
+    {
+        slot = *entry;
+        disk_refaults++;
+        disk_refault_distance += deactivations - slot_evicted_at[slot];
+        if (deactivations - slot_evicted_at[slot] < ALL_MEM_PGS)
+            disk_refaults_near++;
+        count_page_in(pid);
+        fault_major[pid] = TRUE;
+        os_disk_read(swap_slot_disk(slot), swap_slot_sector(slot),
+                     (char *) &MEMORY[frame_number * PGSIZE]);
+    }
+
+    // While this process waited, another mapper of a shared page may have
+    // brought it in already.
+    if (*pte & PTBL_VALID_BIT)
+    {
+        fresh_frame[frame_number] = FALSE;
+        add_to_frame_queue(frame_number);
+        return (INT16) (*pte & PTBL_FRAME_BITS);
+    }
+    *pte = frame_number | PTBL_VALID_BIT;
+    attach_frame(frame_number, pid, vpn, pte);
+    return frame_number;
+}
+
+/**
+ * Map a virtual page of the current process to a frame. A page of a shared
+ * area is brought in through the entry of the area, unless another mapper
+ * has it in memory already, and the frame is then entered in the page
+ * table of the process as well.
+ * @param pid: The current process.
+ * @param vpn: The virtual page number to map.
+ */
+static void map_page(INT32 pid, INT32 vpn)
+{
+    INT16 frame_number;
+    INT32 page;
+    UINT32 *pte = lookup_pte(pid, vpn, TRUE);
+    SharedArea *area = find_shared_area(pid, vpn, &page);
+
+    if (!area)
+    {
+        load_page(pid, vpn, pte, lookup_swap_entry(pid, vpn));
+        return;
+    }
+    if (area->pte[page] & PTBL_VALID_BIT)
+        frame_number = (INT16) (area->pte[page] & PTBL_FRAME_BITS);
+    else
+        frame_number = load_page(pid, vpn, &area->pte[page], &area->swap[page]);
+    shared_area_of[frame_number] = (INT16) (area - shared_areas);
+    *pte = frame_number | PTBL_VALID_BIT;
+    frame_mappers[frame_number]++;
+    shared_pages_mapped++;
+}
+
+/**
+ * Map the other pages of the aligned block around a fault, as long as that
+ * needs no disk I/O: untouched pages get a zeroed or free frame, pages read ahead into
+ * the swap cache are mapped from there. Nothing is evicted for them, and they are mapped
+ * unreferenced, so the clock takes them first if they turn out to be unused. Shared
+ * areas are left alone, and so are disk-mapped pages which are not cached
+ * and missing pages a fault handler fills. A process at its quota gets no
+ * more untouched pages.
+ * @param pid: The current process.
+ * @param vpn: The virtual page number which faulted.
+ * @param pages: The size of the block, taken from the process.
+ */
+static void fault_around(INT32 pid, INT32 vpn, INT32 pages)
+{
+    INT32 target;
+    INT32 start;
+    INT32 page;
+    INT16 frame_number;
+    UINT32 *pte;
+
+    if (pages <= 1)
+        return;
+    start = vpn - vpn % pages;
+    for (target = start; target < start + pages; target++)
+    {
+        pte = lookup_pte(pid, target, FALSE);
+        if (!pte || find_shared_area(pid, target, &page))
+            continue;
+        if (*pte & PTBL_VALID_BIT)
+            continue;
+        frame_number = find_swap_cache_frame(pte);
+        // An inactive page was found cold, only a touch of its own brings it
+        // back. A page still being read ahead is left to its own fault.
+        if (frame_number >= 0 && reading_ahead[frame_number])
+            continue;
+        if (frame_number >= 0 && !inactive[frame_number])
+        {
+            map_cached_page(pid, frame_number);
+            fault_around_mapped++;
+            continue;
+        }
+        if ((*pte & PTBL_RESERVED_BIT) || find_disk_map(pid, target, &page)
+                || find_userfault_handler(pid, target) >= 0)
+            continue;
+        if (at_frame_quota(pid))
+            return;
+
+        frame_number = get_frame_number_of_zeroed_frame();
+        if (frame_number >= 0)
+            zero_pool_hits++;
+        else
+        {
+            frame_number = get_frame_number_of_removed_frame();
+            if (frame_number < 0)
+                return;
+            memset(&MEMORY[frame_number * PGSIZE], 0, PGSIZE);
+            zero_pool_misses++;
+        }
+        *pte = frame_number | PTBL_VALID_BIT;
+        attach_frame(frame_number, pid, target, pte);
+        fresh_frame[frame_number] = TRUE;
+        fault_around_mapped++;
+    }
+}
+
+/**
+ * Map a whole block of LARGE_PAGE_PGS pages around a fault to an aligned run
+ * of frames, as a large page. Only done for a block of anonymous pages none of
+ * which was touched yet, right after the block before it was filled, and only
+ * when the block fits in the frame limit of the process and the buddy
+ * allocator has a free run, nothing is evicted for it.
+ * @param pid: The current process.
+ * @param vpn: The virtual page number which faulted.
+ * @return: TRUE if the block is mapped, FALSE if the page is left to map_page().
+ */
+static BOOL map_large_page(INT32 pid, INT32 vpn)
+{
+    INT32 start = vpn - vpn % LARGE_PAGE_PGS;
+    INT32 page;
+    INT16 run;
+    UINT32 *pte;
+    int i;
+
+    if (!CurrentPCB->large_pages || start == 0 || start + LARGE_PAGE_PGS > CurrentPCB->virtual_pages
+            || resident_pages[pid] + LARGE_PAGE_PGS > frame_limit(pid))
+        return FALSE;
+    for (i = -LARGE_PAGE_PGS; i < LARGE_PAGE_PGS; i++)
+    {
+        pte = lookup_pte(pid, start + i, FALSE);
+        if (find_shared_area(pid, start + i, &page) || find_disk_map(pid, start + i, &page)
+                || find_userfault_handler(pid, start + i) >= 0)
+            return FALSE;
+        if (i < 0 && (!pte || !(*pte & PTBL_VALID_BIT)))
+            return FALSE;
+        if (i >= 0 && pte && *pte)
+            return FALSE;
+    }
+    run = buddy_allocate(LARGE_PAGE_ORDER);
+    if (run < 0)
+    {
+        large_page_fallbacks++;
+        return FALSE;
+    }
+
+    for (i = 0; i < LARGE_PAGE_PGS; i++)
+    {
+        if (!take_queued_frame(run + i))
+            memset(&MEMORY[(run + i) * PGSIZE], 0, PGSIZE);
+        pte = lookup_pte(pid, start + i, TRUE);
+        *pte = (run + i) | PTBL_VALID_BIT | PTBL_LARGE_PAGE_BIT;
+        attach_frame(run + i, pid, start + i, pte);
+        fresh_frame[run + i] = TRUE;
+    }
+    large_pages_mapped++;
+    return TRUE;
+}
+
+/**
+ * Evict every page a process holds in memory, so its frames can be used by
+ * the processes which keep running.
+ * @param pid: The process swapped out.
+ */
+static void page_out_process(INT32 pid)
+{
+    INT16 frame_number;
+
+    for (frame_number = 0; frame_number < ALL_MEM_PGS; frame_number++)
+    {
+        if (shadow_pg_tbl[frame_number] == NULL || writing_back[frame_number]
+                || reading_ahead[frame_number] || process_holder[frame_number] != pid)
+            continue;
+        load_pages_evicted++;
+        if (page_out(frame_number))
+            add_to_frame_queue(frame_number);
+    }
+}
+
+/**
+ * Count a page fault towards the page fault frequency, and once a window
+ * has passed, swap a whole process out if the system is thrashing, or let
+ * one back in if the pressure is gone.
+ * @param now: The time of the fault.
+ */
+static void control_load(INT32 now)
+{
+    INT32 elapsed = now - load_window_start;
+    INT32 rate;
+    PCB *pcb;
+
+    load_window_faults++;
+    if (elapsed < LOAD_CONTROL_WINDOW)
+        return;
+
+    rate = load_window_faults * LOAD_CONTROL_WINDOW / elapsed;
+    load_window_start = now;
+    load_window_faults = 0;
+
+    if (rate > LOAD_CONTROL_HIGH_WATER)
+    {
+        pcb = swap_out_process();
+        if (pcb)
+        {
+            load_swap_outs++;
+            page_out_process(pcb->pid);
+        }
+    }
+    else if (rate < LOAD_CONTROL_LOW_WATER && swap_in_process())
+        load_swap_ins++;
+}
+
+/**
+ * Resolve a write to a page shared copy-on-write. The writer gets a copy of
+ * the frame, unless nobody else maps it any more, then it keeps the frame
+ * and the protection is lifted. A copying owner hands the frame over to one
+ * of the other mappers.
+ * @param pid: The current process.
+ * @param vpn: The virtual page number written to.
+ * @param pte: The page table entry of the page, valid and protected.
+ */
+static void copy_on_write(INT32 pid, INT32 vpn, UINT32 *pte)
+{
+    INT16 frame_number = (INT16) (*pte & PTBL_FRAME_BITS);
+    INT16 copy;
+    INT32 tlb_frame = frame_number;
+    INT32 heir;
+
+    if (process_holder[frame_number] == pid && find_cow_sharer(frame_number) < 0)
+    {
+        *pte &= ~PTBL_PROTECTED_BIT;
+        cow_unprotected++;
+        return;
+    }
+
+    copy = -1;
+    if (!at_frame_quota(pid))
+    {
+        copy = get_frame_number_of_removed_frame();
+        if (copy < 0)
+            copy = get_frame_number_of_zeroed_frame();
+    }
+    if (copy < 0)
+        copy = reclaim_frame(pid);
+
+    // While a frame was reclaimed, the page may have been evicted, or the
+    // other mappers may have gone.
+    if ((*pte & (PTBL_VALID_BIT | PTBL_PROTECTED_BIT)) != (PTBL_VALID_BIT | PTBL_PROTECTED_BIT)
+            || (*pte & PTBL_FRAME_BITS) != frame_number)
+    {
+        add_to_frame_queue(copy);
+        return;
+    }
+    if (process_holder[frame_number] == pid)
+    {
+        heir = find_cow_sharer(frame_number);
+        if (heir < 0)
+        {
+            add_to_frame_queue(copy);
+            *pte &= ~PTBL_PROTECTED_BIT;
+            cow_unprotected++;
+            return;
+        }
+        hand_over_cow_frame(frame_number, heir);
+    }
+
+    memcpy(&MEMORY[copy * PGSIZE], &MEMORY[frame_number * PGSIZE], PGSIZE);
+    write_to_memory(Z502TLBInvalidate, &tlb_frame);
+    *pte = copy | PTBL_VALID_BIT | (*pte & PTBL_MODIFIED_BIT);
+    attach_frame(copy, pid, vpn, pte);
+    fresh_frame[copy] = FALSE;
+    cow_copies++;
+}
+
+/**
+ * Hand a fault on a missing page of a range registered for user-level fault
+ * handling to the handler of the range: a fault message is queued for it,
+ * the handler is woken if it waits for one, and the process is blocked
+ * until the page is installed or the handler terminates. The access is
+ * then retried.
+ * @param pid: The current process.
+ * @param vpn: The virtual page number which faulted.
+ * @return: TRUE if the fault went to the handler, FALSE if it is left to
+ * the pager.
+ */
+static BOOL raise_userfault(INT32 pid, INT32 vpn)
+{
+    INT32 handler = find_userfault_handler(pid, vpn);
+    UINT32 *pte;
+
+    if (handler < 0)
+        return FALSE;
+    pte = lookup_pte(pid, vpn, FALSE);
+    if (pte && *pte)
+        return FALSE;
+
+    userfault_vpn[pid] = vpn;
+    userfault_handler[pid] = handler;
+    userfault_delivered[pid] = FALSE;
+    userfault_raised_at[pid] = userfaults_raised++;
+    if (receiving_faults[handler])
+    {
+        receiving_faults[handler] = FALSE;
+        os_wake_process(handler);
+    }
+    while (userfault_vpn[pid] == vpn)
+        os_block_process();
+    return TRUE;
+}
+
+/**
+ * Deal with a page fault of the current process and map the pages to the
+ * frames. The page directory of a process is created on its first fault,
+ * unless it was cloned from its parent already.
+ * @param status: The virtual page number obtained from fault handler.
+ * @param now: The time of the fault.
+ */
+static void serve_fault(INT32 status, INT32 now)
+{
+    INT32 pid;
+    INT32 stride;
+    INT32 advice;
+    INT16 offset;
+    UINT32 *pte;
+    offset = Z502_REG3 % PGSIZE;
+    pid = CurrentPCB->pid;
+
+    if (!Z502_PAGE_DIR_ADDR)
+    {
+        if (!page_dir_holder[pid])
+        {
+            page_dir_length[pid] = (CurrentPCB->virtual_pages + PTBL_LEAF_ENTRIES - 1) / PTBL_LEAF_ENTRIES;
+            page_dir_holder[pid] = (UINT32 **) calloc(page_dir_length[pid], sizeof (UINT32 *));
+            swap_dir_holder[pid] = (INT32 **) calloc(page_dir_length[pid], sizeof (INT32 *));
+            if (!page_dir_holder[pid] || !swap_dir_holder[pid])
+            {
+                error_message("Page directory allocation fails.");
+                shut_down();
+            }
+        }
+        Z502_PAGE_TBL_LENGTH = (INT16) page_dir_length[pid];
+        Z502_PAGE_DIR_ADDR = page_dir_holder[pid];
+        last_fault_vpn[pid] = -1;
+        fault_stride[pid] = 0;
+        read_ahead_window[pid] = READ_AHEAD_MIN_WINDOW;
+        frame_target[pid] = WORKING_SET_INITIAL_FRAMES;
+        if (total_frame_target + frame_target[pid] > ALL_MEM_PGS)
+            frame_target[pid] = WORKING_SET_MIN_FRAMES;
+        total_frame_target += frame_target[pid];
+        frame_quota[pid] = CurrentPCB->frame_quota;
+        last_fault_time[pid] = now;
+    }
+
+    control_load(now);
+    adjust_frame_target(pid);
+    priority_faults[CurrentPCB->priority]++;
+
+    if (raise_userfault(pid, status)
+            || (offset > PGSIZE - 4 && raise_userfault(pid, status + 1)))
+        return;
+
+    // If page is invalid, it is either brand new or in the swap space.
+    // A valid page faults on a write when it is shared copy-on-write.
+    pte = lookup_pte(pid, status, FALSE);
+    advice = advice_at(pid, status);
+    if (!pte || !(*pte & PTBL_VALID_BIT))
+    {
+        if (advice == ADVICE_RANDOM || !map_large_page(pid, status))
+            map_page(pid, status);
+    }
+    else if (*pte & PTBL_PROTECTED_BIT)
+        copy_on_write(pid, status, pte);
+
+    // If the access wraps over to the next page, that page is needed as well.
+    if (offset > PGSIZE - 4 && status + 1 < CurrentPCB->virtual_pages)
+    {
+        pte = lookup_pte(pid, status + 1, FALSE);
+        if (!pte || !(*pte & PTBL_VALID_BIT))
+            map_page(pid, status + 1);
+        else if (*pte & PTBL_PROTECTED_BIT)
+            copy_on_write(pid, status + 1, pte);
+    }
+
+    if (advice != ADVICE_RANDOM)
+        fault_around(pid, status, CurrentPCB->fault_around);
+
+    // Two faults in a row with the same stride make a pattern worth reading
+    // ahead, a range advised sequential is read ahead at full window anyway.
+    stride = status - last_fault_vpn[pid];
+    if (advice == ADVICE_SEQUENTIAL)
+    {
+        read_ahead_window[pid] = READ_AHEAD_MAX_WINDOW;
+        read_ahead(pid, status, 1);
+        if (stride > 0 && stride <= SEQUENTIAL_DROP_DISTANCE)
+            drop_behind(pid, last_fault_vpn[pid] - SEQUENTIAL_DROP_DISTANCE, stride);
+    }
+    else if (advice != ADVICE_RANDOM && stride != 0 && stride == fault_stride[pid])
+        read_ahead(pid, status, stride);
+    fault_stride[pid] = stride;
+    last_fault_vpn[pid] = status;
+
+    refill_inactive_list(pid, status, offset > PGSIZE - 4 ? status + 1 : status);
+    balance_memory_tiers();
+}
+
+/**
+ * Count a fault in the paging statistics of its process and of the system.
+ * @param pid: The process which faulted.
+ * @param latency: The simulated time it took to serve the fault.
+ */
+static void account_fault(INT32 pid, INT32 latency)
+{
+    PAGING_STATS *stats[2] = {&paging_stats[pid], &system_paging_stats};
+    int bucket = 0;
+    int i;
+
+    while (bucket < FAULT_LATENCY_BUCKETS - 1 && latency >= FAULT_LATENCY_BASE << bucket)
+        bucket++;
+    for (i = 0; i < 2; i++)
+    {
+        if (fault_major[pid])
+            stats[i]->major_faults++;
+        else
+            stats[i]->minor_faults++;
+        stats[i]->fault_latency[bucket]++;
+    }
+}
+
+/**
+ * Used in fault handler. Deal with the page fault and map the pages to the
+ * frames, and count the fault in the paging statistics.
+ * @param status: The virtual page number obtained from fault handler.
+ */
+void frame_scheduler(INT32 status)
+{
+    INT32 pid = CurrentPCB->pid;
+    INT32 start = get_current_time();
+
+    fault_major[pid] = FALSE;
+    serve_fault(status, start);
+    // Read the end straight from the simulator, a clock read would charge time.
+    account_fault(pid, (INT32) CurrentSimulationTime - start);
+    note_free_frames();
+}
+
+/**
+ * Take a process out of a shared area. The frames of the area charged to the
+ * process are handed to another mapper. When the last mapper leaves, they
+ * stay charged to it and are freed with its other frames, and the swap
+ * slots and entries of the area are released.
+ * @param area: The area.
+ * @param pid: The process leaving the area.
+ */
+static void leave_shared_area(SharedArea *area, INT32 pid)
+{
+    INT16 frame_number;
+    INT32 start = area->start_vpn[pid];
+    INT32 heir = -1;
+    INT32 page;
+    INT32 i;
+    UINT32 *pte;
+
+    for (page = 0; page < area->pages; page++)
+    {
+        pte = lookup_pte(pid, start + page, FALSE);
+        if (pte && (*pte & PTBL_VALID_BIT))
+            frame_mappers[*pte & PTBL_FRAME_BITS]--;
+    }
+    area->start_vpn[pid] = -1;
+    area->mappers--;
+    for (i = 0; i < MAX_NUMBER_OF_USER_PROCESSES; i++)
+        if (area->start_vpn[i] >= 0)
+            heir = i;
+
+    for (frame_number = 0; frame_number < ALL_MEM_PGS; frame_number++)
+    {
+        if (shadow_pg_tbl[frame_number] == NULL
+                || shared_area_of[frame_number] != area - shared_areas)
+            continue;
+        if (heir < 0 || process_holder[frame_number] != pid)
+            continue;
+        resident_pages[pid]--;
+        resident_pages[heir]++;
+        process_holder[frame_number] = heir;
+        vpn_holder[frame_number] = vpn_holder[frame_number] - start + area->start_vpn[heir];
+    }
+    if (heir >= 0)
+        return;
+
+    for (page = 0; page < area->pages; page++)
+        release_swap_slot(area->swap[page]);
+    free(area->pte);
+    free(area->swap);
+    area->pages = 0;
+}
+
+/**
+ * Whether the page of a frame may be merged with another: mapped, private,
+ * and not on its way out.
+ * @param frame_number: The frame.
+ * @return: TRUE if the frame may be merged.
+ */
+static BOOL can_merge_frame(INT16 frame_number)
+{
+    INT32 sector;
+
+    return shadow_pg_tbl[frame_number] && (*shadow_pg_tbl[frame_number] & PTBL_VALID_BIT)
+            && !writing_back[frame_number] && !inactive[frame_number]
+            && !swap_cache[frame_number] && shared_area_of[frame_number] < 0
+            && !find_disk_map(process_holder[frame_number], vpn_holder[frame_number], &sector);
+}
+
+/**
+ * Compute the FNV-1a checksum of the page a frame holds.
+ * @param frame_number: The frame.
+ * @return: The checksum.
+ */
+static UINT32 checksum_frame(INT16 frame_number)
+{
+    UINT32 sum = 2166136261u;
+    int i;
+
+    for (i = 0; i < PGSIZE; i++)
+        sum = (sum ^ (unsigned char) MEMORY[frame_number * PGSIZE + i]) * 16777619u;
+    return sum;
+}
+
+/**
+ * Merge identical pages, called when the OS is idle. A frame which kept its
+ * content since it was last scanned, and holds the same bytes as the frame
+ * of another process at the same virtual page, is freed. Its process maps
+ * the other frame copy-on-write instead.
+ */
+void merge_identical_frames(void)
+{
+    INT16 frame_number;
+    INT16 other;
+    INT32 tlb_frame;
+    UINT32 sum;
+    UINT32 *pte;
+    int steps;
+
+    for (steps = 0; steps < MERGE_SCAN_FRAMES; steps++)
+    {
+        merge_idx = (merge_idx + 1) % ALL_MEM_PGS;
+        frame_number = (INT16) merge_idx;
+        if (!can_merge_frame(frame_number))
+            continue;
+        merge_scanned++;
+
+        // A page which keeps changing would only be copied back right away.
+        sum = checksum_frame(frame_number);
+        if (sum != frame_checksum[frame_number])
+        {
+            frame_checksum[frame_number] = sum;
+            continue;
+        }
+        // Frames still shared by a fork would leave their other mappers behind.
+        if ((*shadow_pg_tbl[frame_number] & PTBL_PROTECTED_BIT)
+                && find_cow_sharer(frame_number) >= 0)
+            continue;
+
+        for (other = 0; other < ALL_MEM_PGS; other++)
+        {
+            if (other == frame_number || !can_merge_frame(other)
+                    || vpn_holder[other] != vpn_holder[frame_number]
+                    || process_holder[other] == process_holder[frame_number]
+                    || frame_checksum[other] != sum
+                    || memcmp(&MEMORY[other * PGSIZE], &MEMORY[frame_number * PGSIZE], PGSIZE))
+                continue;
+
+            pte = shadow_pg_tbl[frame_number];
+            tlb_frame = frame_number;
+            write_to_memory(Z502TLBInvalidate, &tlb_frame);
+            *pte = other | PTBL_VALID_BIT | PTBL_PROTECTED_BIT
+                    | (*pte & (PTBL_MODIFIED_BIT | PTBL_REFERENCED_BIT));
+            *shadow_pg_tbl[other] |= PTBL_PROTECTED_BIT;
+            fresh_frame[frame_number] = FALSE;
+            detach_frame(frame_number);
+            add_to_frame_queue(frame_number);
+            merge_merged++;
+            break;
+        }
+    }
+}
+
+/**
+ * Whether the page of a frame may be moved to the other tier: mapped, private,
+ * and neither on its way out nor shared copy-on-write.
+ * @param frame_number: The frame.
+ * @return: TRUE if the page may be moved.
+ */
+static BOOL can_move_frame(INT16 frame_number)
+{
+    return shadow_pg_tbl[frame_number] && (*shadow_pg_tbl[frame_number] & PTBL_VALID_BIT)
+            && !writing_back[frame_number] && !inactive[frame_number]
+            && !swap_cache[frame_number] && shared_area_of[frame_number] < 0
+            && !(*shadow_pg_tbl[frame_number] & (PTBL_PROTECTED_BIT | PTBL_LARGE_PAGE_BIT));
+}
+
+/**
+ * Whether the page of a frame may be collapsed into a large page. Like
+ * can_move_frame(), but the pages of a large page count as well, so a block
+ * is collapsed again after one of its pages was evicted and faulted back.
+ * @param frame_number: The frame.
+ * @return: TRUE if the page may be collapsed.
+ */
+static BOOL can_collapse_frame(INT16 frame_number)
+{
+    return can_move_frame(frame_number) || (shadow_pg_tbl[frame_number] && !writing_back[frame_number]
+            && (*shadow_pg_tbl[frame_number] & (PTBL_VALID_BIT | PTBL_PROTECTED_BIT | PTBL_LARGE_PAGE_BIT))
+            == (PTBL_VALID_BIT | PTBL_LARGE_PAGE_BIT));
+}
+
+/**
+ * Move the page of a frame to a free frame, and point its page table entry
+ * at the new frame. The old frame is left without an owner.
+ * @param from: The frame holding the page.
+ * @param to: The free frame.
+ */
+static void move_page(INT16 from, INT16 to)
+{
+    INT32 tlb_frame = from;
+    UINT32 *pte = shadow_pg_tbl[from];
+
+    write_to_memory(Z502TLBInvalidate, &tlb_frame);
+    memcpy(&MEMORY[to * PGSIZE], &MEMORY[from * PGSIZE], PGSIZE);
+    *pte = (*pte & ~PTBL_FRAME_BITS) | to;
+    shadow_pg_tbl[to] = pte;
+    process_holder[to] = process_holder[from];
+    vpn_holder[to] = vpn_holder[from];
+    fresh_frame[to] = fresh_frame[from];
+    frame_heat[to] = frame_heat[from];
+    frame_checksum[to] = frame_checksum[from];
+    shadow_pg_tbl[from] = NULL;
+    fresh_frame[from] = FALSE;
+}
+
+/**
+ * Exchange the pages of two frames, along with everything known about them.
+ * @param a: The first frame.
+ * @param b: The second frame.
+ */
+static void exchange_pages(INT16 a, INT16 b)
+{
+    char page[PGSIZE];
+    INT32 tlb_frame;
+    UINT32 *pte;
+    UINT16 pid;
+    INT32 vpn;
+    char fresh;
+    unsigned char heat;
+    UINT32 sum;
+
+    tlb_frame = a;
+    write_to_memory(Z502TLBInvalidate, &tlb_frame);
+    tlb_frame = b;
+    write_to_memory(Z502TLBInvalidate, &tlb_frame);
+    memcpy(page, &MEMORY[a * PGSIZE], PGSIZE);
+    memcpy(&MEMORY[a * PGSIZE], &MEMORY[b * PGSIZE], PGSIZE);
+    memcpy(&MEMORY[b * PGSIZE], page, PGSIZE);
+    *shadow_pg_tbl[a] = (*shadow_pg_tbl[a] & ~PTBL_FRAME_BITS) | b;
+    *shadow_pg_tbl[b] = (*shadow_pg_tbl[b] & ~PTBL_FRAME_BITS) | a;
+
+    pte = shadow_pg_tbl[a];
+    pid = process_holder[a];
+    vpn = vpn_holder[a];
+    fresh = fresh_frame[a];
+    heat = frame_heat[a];
+    sum = frame_checksum[a];
+    shadow_pg_tbl[a] = shadow_pg_tbl[b];
+    process_holder[a] = process_holder[b];
+    vpn_holder[a] = vpn_holder[b];
+    fresh_frame[a] = fresh_frame[b];
+    frame_heat[a] = frame_heat[b];
+    frame_checksum[a] = frame_checksum[b];
+    shadow_pg_tbl[b] = pte;
+    process_holder[b] = pid;
+    vpn_holder[b] = vpn;
+    fresh_frame[b] = fresh;
+    frame_heat[b] = heat;
+    frame_checksum[b] = sum;
+}
+
+/**
+ * Find the coldest page of the fast tier which is colder than a given heat,
+ * and was not referenced since the last scan.
+ * @param heat: The heat of the page to promote.
+ * @return: The number of the frame, -1 if there is none.
+ */
+static INT16 find_cold_fast_frame(unsigned char heat)
+{
+    INT16 frame_number;
+    INT16 coldest = -1;
+
+    for (frame_number = 0; frame_number < PHYS_MEM_PGS; frame_number++)
+    {
+        if (!can_move_frame(frame_number) || frame_heat[frame_number] >= heat
+                || (frame_heat[frame_number] & FRAME_HEAT_RECENT)
+                || (*shadow_pg_tbl[frame_number] & PTBL_REFERENCED_BIT))
+            continue;
+        if (coldest < 0 || frame_heat[frame_number] < frame_heat[coldest])
+            coldest = frame_number;
+    }
+    return coldest;
+}
+
+/**
+ * Balance the pages between the memory tiers, called after every fault and
+ * when the OS is idle. TIER_SCAN_FRAMES frames have the referenced bit of their
+ * page shifted into their heat. A page of the slow tier which turns hot is
+ * promoted to a free frame of the fast tier, or exchanged with the coldest
+ * page there, which is demoted.
+ */
+void balance_memory_tiers(void)
+{
+    INT16 frame_number;
+    INT16 target;
+    Frame *frm;
+    UINT32 *pte;
+    int steps;
+
+    if (SLOW_MEM_PGS == 0)
+        return;
+    for (steps = 0; steps < TIER_SCAN_FRAMES; steps++)
+    {
+        tier_idx = (tier_idx + 1) % ALL_MEM_PGS;
+        frame_number = (INT16) tier_idx;
+        if (!can_move_frame(frame_number))
+            continue;
+        pte = shadow_pg_tbl[frame_number];
+        frame_heat[frame_number] >>= 1;
+        if (*pte & PTBL_REFERENCED_BIT)
+        {
+            frame_heat[frame_number] |= FRAME_HEAT_RECENT;
+            *pte &= ~PTBL_REFERENCED_BIT;
+        }
+        if (is_fast_frame(frame_number) || frame_heat[frame_number] < TIER_HOT_HEAT)
+            continue;
+
+        if (FastFrameQueue->size)
+        {
+            queue_dequeue(FastFrameQueue, (void**) &frm);
+            target = frm->frame_number;
+            buddy_claim(target);
+            free(frm);
+            move_page(frame_number, target);
+            add_to_frame_queue(frame_number);
+            tier_promotions++;
+        }
+        else if ((target = find_cold_fast_frame(frame_heat[frame_number])) >= 0)
+        {
+            exchange_pages(frame_number, target);
+            tier_promotions++;
+            tier_demotions++;
+        }
+    }
+}
+
+/**
+ * Collapse blocks of pages into large pages, called when the OS is idle. For
+ * each of the next COLLAPSE_SCAN_FRAMES frames holding a page, the aligned
+ * block of LARGE_PAGE_PGS pages around its page is looked at. If every page of the block is resident
+ * and may be moved, the pages are moved into an aligned run of frames from the
+ * buddy allocator, unless they are in one already, and mapped as a large page.
+ */
+void collapse_large_pages(void)
+{
+    INT16 frames[LARGE_PAGE_PGS];
+    INT16 frame_number;
+    INT16 run;
+    INT32 pid;
+    INT32 start;
+    UINT32 *pte;
+    int steps;
+    int scanned = 0;
+    int i;
+
+    for (steps = 0; steps < ALL_MEM_PGS && scanned < COLLAPSE_SCAN_FRAMES; steps++)
+    {
+        collapse_idx = (collapse_idx + 1) % ALL_MEM_PGS;
+        frame_number = (INT16) collapse_idx;
+        if (!can_move_frame(frame_number))
+            continue;
+        scanned++;
+        pid = process_holder[frame_number];
+        start = vpn_holder[frame_number] - vpn_holder[frame_number] % LARGE_PAGE_PGS;
+        for (i = 0; i < LARGE_PAGE_PGS; i++)
+        {
+            pte = lookup_pte(pid, start + i, FALSE);
+            if (!pte || !(*pte & PTBL_VALID_BIT))
+                break;
+            frames[i] = (INT16) (*pte & PTBL_FRAME_BITS);
+            if (shadow_pg_tbl[frames[i]] != pte || !can_collapse_frame(frames[i]))
+                break;
+        }
+        if (i < LARGE_PAGE_PGS)
+            continue;
+
+        run = frames[0] - frames[0] % LARGE_PAGE_PGS;
+        for (i = 0; i < LARGE_PAGE_PGS && frames[i] == run + i; i++)
+            ;
+        if (i < LARGE_PAGE_PGS)
+        {
+            run = buddy_allocate(LARGE_PAGE_ORDER);
+            if (run < 0)
+            {
+                large_page_fallbacks++;
+                return;
+            }
+            for (i = 0; i < LARGE_PAGE_PGS; i++)
+            {
+                take_queued_frame(run + i);
+                move_page(frames[i], run + i);
+                add_to_frame_queue(frames[i]);
+            }
+        }
+        for (i = 0; i < LARGE_PAGE_PGS; i++)
+            *shadow_pg_tbl[run + i] |= PTBL_LARGE_PAGE_BIT;
+        large_pages_collapsed++;
+    }
+}
+
+/**
+ * Give a child process a copy-on-write clone of the address space of its
+ * parent. Resident pages are mapped into the child at the same frames, and
+ * both are protected, so the first write of either gets a copy. Swapped
+ * pages share the swap slot. The child joins the shared areas of the parent
+ * at the same addresses, and inherits its memory advice. Disk maps are not
+ * passed on, their range is left untouched in the child.
+ * @param parent: The pid of the forking process.
+ * @param child: The pid of the new process, which has not run yet.
+ */
+void clone_address_space(INT32 parent, INT32 child)
+{
+    INT32 dir_idx;
+    INT32 vpn;
+    INT32 page;
+    INT32 *entry;
+    UINT32 *pte;
+    UINT32 *child_pte;
+    int i;
+
+    memcpy(advice_ranges[child], advice_ranges[parent], sizeof (advice_ranges[parent]));
+    advice_count[child] = advice_count[parent];
+    if (!page_dir_holder[parent])
+        return;
+    page_dir_length[child] = page_dir_length[parent];
+    page_dir_holder[child] = (UINT32 **) calloc(page_dir_length[child], sizeof (UINT32 *));
+    swap_dir_holder[child] = (INT32 **) calloc(page_dir_length[child], sizeof (INT32 *));
+    if (!page_dir_holder[child] || !swap_dir_holder[child])
+    {
+        error_message("Page directory allocation fails.");
+        shut_down();
+    }
+
+    for (i = 0; i < MAX_NUMBER_OF_SHARED_AREAS; i++)
+    {
+        if (shared_areas[i].pages && shared_areas[i].start_vpn[parent] >= 0)
+        {
+            shared_areas[i].start_vpn[child] = shared_areas[i].start_vpn[parent];
+            shared_areas[i].mappers++;
+        }
+    }
+
+    for (dir_idx = 0; dir_idx < page_dir_length[parent]; dir_idx++)
+    {
+        if (!page_dir_holder[parent][dir_idx])
+            continue;
+        for (i = 0; i < PTBL_LEAF_ENTRIES; i++)
+        {
+            vpn = dir_idx * PTBL_LEAF_ENTRIES + i;
+            pte = &page_dir_holder[parent][dir_idx][i];
+            if (!*pte || find_shared_area(parent, vpn, &page)
+                    || find_disk_map(parent, vpn, &page))
+                continue;
+            child_pte = lookup_pte(child, vpn, TRUE);
+            entry = lookup_swap_entry(child, vpn);
+            *entry = swap_dir_holder[parent][dir_idx][i];
+            share_swap_slot(*entry);
+            if (*pte & PTBL_VALID_BIT)
+            {
+                *pte |= PTBL_PROTECTED_BIT;
+                *child_pte = *pte;
+                cow_pages_shared++;
+            }
+            else if (*pte & PTBL_RESERVED_BIT)
+                *child_pte = PTBL_RESERVED_BIT;
+        }
+    }
+}
+
+/**
+ * Drop the user-level fault handling a terminated process took part in. Its
+ * own ranges are forgotten, and the ranges it handled for others go back to
+ * the pager; a process waiting on it for a page is woken to fault again.
+ * @param pid: The terminated process.
+ */
+static void release_userfault_ranges(INT32 pid)
+{
+    INT32 other;
+    int i;
+    int kept;
+
+    userfault_count[pid] = 0;
+    userfault_vpn[pid] = -1;
+    receiving_faults[pid] = FALSE;
+    for (other = 0; other < MAX_NUMBER_OF_USER_PROCESSES; other++)
+    {
+        kept = 0;
+        for (i = 0; i < userfault_count[other]; i++)
+            if (userfault_ranges[other][i].handler != pid)
+                userfault_ranges[other][kept++] = userfault_ranges[other][i];
+        userfault_count[other] = kept;
+        if (userfault_vpn[other] >= 0 && userfault_handler[other] == pid)
+        {
+            userfault_vpn[other] = -1;
+            os_wake_process(other);
+        }
+    }
+}
+
+/**
+ * Check whether a frame of a process is being written back.
+ * @param pid: The process.
+ * @return: TRUE if a write back of a frame of the process is in flight.
+ */
+static BOOL address_space_busy(INT32 pid)
+{
+    INT16 frame_number;
+
+    for (frame_number = 0; frame_number < ALL_MEM_PGS; frame_number++)
+        if (writing_back[frame_number] && shadow_pg_tbl[frame_number]
+                && process_holder[frame_number] == pid)
+            return TRUE;
+    return FALSE;
+}
+
+/**
+ * Clear the paging state and statistics a pid kept from the process which
+ * had it before, so a new process starts with none of them.
+ * @param pid: The pid of the new process.
+ */
+void reset_paging_state(INT32 pid)
+{
+    memset(&paging_stats[pid], 0, sizeof (PAGING_STATS));
+    fault_major[pid] = FALSE;
+    tlb_hits[pid] = 0;
+    tlb_misses[pid] = 0;
+    last_fault_vpn[pid] = -1;
+    fault_stride[pid] = 0;
+    read_ahead_window[pid] = READ_AHEAD_MIN_WINDOW;
+    resident_pages[pid] = 0;
+    last_fault_time[pid] = 0;
+    frame_waiter[pid] = FALSE;
+}
+
+/**
+ * Tear down the address space of a terminated process. It leaves its shared
+ * areas, its frames go back to the frame queue, its swap slots to the free
+ * pool, and its page tables are freed. A frame it shares copy-on-write goes
+ * to another of its mappers. While a frame of the process is being written
+ * back, only its other private frames are freed: the writer still updates
+ * the page table entry and the swap slot of the page, and the call has to be
+ * repeated once the write is done.
+ * @param pid: The terminated process.
+ * @return: TRUE if the address space is gone, FALSE if a write back holds it.
+ */
+BOOL release_address_space(INT32 pid)
+{
+    INT16 frame_number;
+    INT32 tlb_frame;
+    INT32 all = -1;
+    INT32 dir_idx;
+    INT32 heir;
+    int i;
+    BOOL busy = address_space_busy(pid);
+
+    for (i = 0; i < MAX_NUMBER_OF_SHARED_AREAS && !busy; i++)
+        if (shared_areas[i].pages && shared_areas[i].start_vpn[pid] >= 0)
+            leave_shared_area(&shared_areas[i], pid);
+
+    for (frame_number = 0; frame_number < ALL_MEM_PGS; frame_number++)
+    {
+        if (shadow_pg_tbl[frame_number] == NULL || process_holder[frame_number] != pid
+                || writing_back[frame_number] || (busy && shared_area_of[frame_number] >= 0))
+            continue;
+        if ((*shadow_pg_tbl[frame_number] & PTBL_VALID_BIT)
+                && (*shadow_pg_tbl[frame_number] & PTBL_PROTECTED_BIT)
+                && (heir = find_cow_sharer(frame_number)) >= 0)
+        {
+            hand_over_cow_frame(frame_number, heir);
+            continue;
+        }
+        tlb_frame = frame_number;
+        write_to_memory(Z502TLBInvalidate, &tlb_frame);
+        if (inactive[frame_number])
+            inactive_count--;
+        inactive[frame_number] = FALSE;
+        swap_cache[frame_number] = FALSE;
+        fresh_frame[frame_number] = FALSE;
+        detach_frame(frame_number);
+        add_to_frame_queue(frame_number);
+    }
+    release_userfault_ranges(pid);
+    if (busy)
+        return FALSE;
+    write_to_memory(Z502InvalidateTranslation, &all);
+
+    total_frame_target -= frame_target[pid];
+    frame_target[pid] = 0;
+    frame_quota[pid] = 0;
+    advice_count[pid] = 0;
+    disk_map_count[pid] = 0;
+    if (!page_dir_holder[pid])
+        return TRUE;
+    for (dir_idx = 0; dir_idx < page_dir_length[pid]; dir_idx++)
+    {
+        if (!page_dir_holder[pid][dir_idx])
+            continue;
+        for (i = 0; i < PTBL_LEAF_ENTRIES; i++)
+            release_swap_slot(swap_dir_holder[pid][dir_idx][i]);
+        free(page_dir_holder[pid][dir_idx]);
+        free(swap_dir_holder[pid][dir_idx]);
+    }
+    free(page_dir_holder[pid]);
+    free(swap_dir_holder[pid]);
+    page_dir_holder[pid] = NULL;
+    swap_dir_holder[pid] = NULL;
+    page_dir_length[pid] = 0;
+    return TRUE;
+}
+
+/**
+ * Define a shared area in the address space of the current process. The
+ * first process to use a tag creates the area, the others map the same
+ * frames. The pages of the range must not have been touched yet.
+ * @param start_address: The virtual address of the area, page aligned.
+ * @param pages: The number of pages of the area.
+ * @param tag: The name of the area.
+ * @param shared_id: Returns how many processes defined the area before.
+ * @param error: The error returned from the function.
+ */
+void os_define_shared_area(long start_address, INT32 pages, const char *tag,
+                           long *shared_id, long *error)
+{
+    INT32 pid = CurrentPCB->pid;
+    INT32 start_vpn = (INT32) (start_address / PGSIZE);
+    INT32 vpn;
+    INT32 page;
+    UINT32 *pte;
+    SharedArea *area = NULL;
+    SharedArea *unused = NULL;
+    int i;
+
+    assert(tag && shared_id && error);
+
+    *error = ERR_BAD_PARAM;
+    if (start_address < 0 || start_address % PGSIZE || pages <= 0
+            || start_vpn + pages > CurrentPCB->virtual_pages
+            || strlen(tag) >= MAX_LENGTH_OF_AREA_TAG)
+        return;
+    for (vpn = start_vpn; vpn < start_vpn + pages; vpn++)
+    {
+        pte = lookup_pte(pid, vpn, FALSE);
+        if ((pte && *pte) || find_shared_area(pid, vpn, &page) || find_disk_map(pid, vpn, &page)
+                || find_userfault_handler(pid, vpn) >= 0)
+            return;
+    }
+
+    for (i = 0; i < MAX_NUMBER_OF_SHARED_AREAS; i++)
+    {
+        if (!shared_areas[i].pages)
+        {
+            if (!unused)
+                unused = &shared_areas[i];
+        }
+        else if (!strcmp(shared_areas[i].tag, tag))
+            area = &shared_areas[i];
+    }
+    if (area && (area->pages != pages || area->start_vpn[pid] >= 0))
+        return;
+    if (!area)
+    {
+        if (!unused)
+            return;
+        area = unused;
+        area->pte = (UINT32 *) calloc(pages, sizeof (UINT32));
+        area->swap = (INT32 *) malloc(pages * sizeof (INT32));
+        if (!area->pte || !area->swap)
+        {
+            error_message("Shared area allocation fails.");
+            shut_down();
+        }
+        for (page = 0; page < pages; page++)
+            area->swap[page] = NO_SWAP_SLOT;
+        strcpy(area->tag, tag);
+        area->pages = pages;
+        area->mappers = 0;
+    }
+
+    *shared_id = area->mappers;
+    area->start_vpn[pid] = start_vpn;
+    area->mappers++;
+    *error = ERR_SUCCESS;
+}
+
+/**
+ * Free a private page of a process, with its frame and swap slot, so it is
+ * back to the untouched state. A frame shared copy-on-write goes to another
+ * of its mappers. A page on its way to its swap slot, or mapped from a
+ * disk, is left alone.
+ * @param pid: The process which owns the page.
+ * @param vpn: The virtual page number.
+ * @return: The value indicates whether the page was freed.
+ */
+static BOOL drop_page(INT32 pid, INT32 vpn)
+{
+    INT16 frame_number;
+    INT32 tlb_frame;
+    INT32 heir;
+    INT32 page;
+    INT32 *entry;
+    UINT32 *pte = lookup_pte(pid, vpn, FALSE);
+
+    if (!pte || !*pte || find_shared_area(pid, vpn, &page) || find_disk_map(pid, vpn, &page))
+        return FALSE;
+    // A page still being read ahead is dropped once the read is done.
+    frame_number = find_swap_cache_frame(pte);
+    if (frame_number >= 0 && reading_ahead[frame_number])
+        wait_for_read_ahead(frame_number);
+    frame_number = (INT16) (*pte & PTBL_FRAME_BITS);
+    if (frame_number < ALL_MEM_PGS && shadow_pg_tbl[frame_number] == pte)
+    {
+        if (writing_back[frame_number])
+            return FALSE;
+        tlb_frame = frame_number;
+        write_to_memory(Z502TLBInvalidate, &tlb_frame);
+        if ((*pte & PTBL_VALID_BIT) && (*pte & PTBL_PROTECTED_BIT)
+                && (heir = find_cow_sharer(frame_number)) >= 0)
+            hand_over_cow_frame(frame_number, heir);
+        else
+        {
+            if (inactive[frame_number])
+                inactive_count--;
+            inactive[frame_number] = FALSE;
+            swap_cache[frame_number] = FALSE;
+            fresh_frame[frame_number] = FALSE;
+            detach_frame(frame_number);
+            add_to_frame_queue(frame_number);
+        }
+    }
+    else if (*pte & PTBL_VALID_BIT)
+    {
+        tlb_frame = frame_number;
+        write_to_memory(Z502TLBInvalidate, &tlb_frame);
+    }
+
+    entry = lookup_swap_entry(pid, vpn);
+    release_swap_slot(*entry);
+    *entry = NO_SWAP_SLOT;
+    *pte = 0;
+    return TRUE;
+}
+
+/**
+ * Give advice on how the current process is going to access a range of its
+ * pages. SEQUENTIAL and RANDOM are kept for the range and change how its
+ * faults are handled, NORMAL takes them back. WILLNEED starts reading the
+ * swapped-out pages of the range now, DONTNEED frees the pages of the range
+ * and their swap slots, so they read as zeros when touched again.
+ * @param start_address: The virtual address of the range, page aligned.
+ * @param pages: The number of pages of the range.
+ * @param advice: One of the ADVICE_ values.
+ * @param error: The error returned from the function.
+ */
+void os_memory_advice(long start_address, INT32 pages, INT32 advice, long *error)
+{
+    INT32 pid = CurrentPCB->pid;
+    INT32 start_vpn = (INT32) (start_address / PGSIZE);
+    INT32 vpn;
+    AdviceRange *range;
+
+    assert(error);
+
+    *error = ERR_BAD_PARAM;
+    if (start_address < 0 || start_address % PGSIZE || pages <= 0
+            || start_vpn + pages > CurrentPCB->virtual_pages
+            || advice < ADVICE_NORMAL || advice > ADVICE_DONTNEED)
+        return;
+    advice_calls++;
+
+    if (advice == ADVICE_WILLNEED)
+    {
+        for (vpn = start_vpn; vpn < start_vpn + pages; vpn++)
+            if (prefetch_page(pid, vpn))
+                advice_prefetched++;
+    }
+    else if (advice == ADVICE_DONTNEED)
+    {
+        for (vpn = start_vpn; vpn < start_vpn + pages; vpn++)
+            if (drop_page(pid, vpn))
+                advice_dropped++;
+    }
+    else
+    {
+        // A full table forgets its oldest range.
+        if (advice_count[pid] == MAX_NUMBER_OF_ADVICE_RANGES)
+        {
+            memmove(&advice_ranges[pid][0], &advice_ranges[pid][1],
+                    (MAX_NUMBER_OF_ADVICE_RANGES - 1) * sizeof (AdviceRange));
+            advice_count[pid]--;
+        }
+        range = &advice_ranges[pid][advice_count[pid]++];
+        range->start_vpn = start_vpn;
+        range->pages = pages;
+        range->advice = advice;
+    }
+    *error = ERR_SUCCESS;
+}
+
+/**
+ * Map a range of sectors of a disk into the address space of the current
+ * process, one sector per page. The pages are read from their sectors when
+ * they are first touched, and written back to them when they are evicted
+ * dirty or synced, they never take a swap slot. The sectors must be logical
+ * ones, out of the swap area, and the pages of the range must not have been
+ * touched yet. A fork does not pass the mapping on. Disk reads and writes of
+ * the same sectors do not see the pages in memory, until they are synced.
+ * @param start_address: The virtual address of the range, page aligned.
+ * @param pages: The number of pages of the range.
+ * @param disk_id: The disk to map.
+ * @param start_sector: The sector mapped to the first page.
+ * @param error: The error returned from the function.
+ */
+void os_map_disk(long start_address, INT32 pages, INT32 disk_id, INT32 start_sector,
+                 long *error)
+{
+    INT32 pid = CurrentPCB->pid;
+    INT32 start_vpn = (INT32) (start_address / PGSIZE);
+    INT32 vpn;
+    INT32 page;
+    UINT32 *pte;
+    DiskMap *map;
+
+    assert(error);
+
+    *error = ERR_BAD_PARAM;
+    if (start_address < 0 || start_address % PGSIZE || pages <= 0
+            || start_vpn + pages > CurrentPCB->virtual_pages
+            || disk_id < 1 || disk_id > MAX_NUMBER_OF_DISKS
+            || start_sector < 0 || start_sector + pages > NUM_LOGICAL_SECTORS
+            || disk_map_count[pid] == MAX_NUMBER_OF_DISK_MAPS)
+        return;
+    for (vpn = start_vpn; vpn < start_vpn + pages; vpn++)
+    {
+        pte = lookup_pte(pid, vpn, FALSE);
+        if ((pte && *pte) || find_shared_area(pid, vpn, &page) || find_disk_map(pid, vpn, &page)
+                || find_userfault_handler(pid, vpn) >= 0)
+            return;
+    }
+
+    map = &disk_maps[pid][disk_map_count[pid]++];
+    map->start_vpn = start_vpn;
+    map->pages = pages;
+    map->disk_id = disk_id;
+    map->start_sector = start_sector;
+    *error = ERR_SUCCESS;
+}
+
+/**
+ * Write the modified disk-mapped pages a process holds in memory within a
+ * range back to their sectors. A page stays mapped while it is written, the
+ * frame is only kept from being evicted, and a write to the page meanwhile
+ * marks it modified again.
+ * @param pid: The process.
+ * @param start_vpn: The first virtual page number of the range.
+ * @param pages: The number of pages of the range.
+ */
+static void sync_disk_range(INT32 pid, INT32 start_vpn, INT32 pages)
+{
+    INT32 vpn;
+    INT32 sector;
+    INT16 frame_number;
+    UINT32 *pte;
+    DiskMap *map;
+
+    for (vpn = start_vpn; vpn < start_vpn + pages; vpn++)
+    {
+        map = find_disk_map(pid, vpn, &sector);
+        pte = lookup_pte(pid, vpn, FALSE);
+        if (!map || !pte || (*pte & (PTBL_VALID_BIT | PTBL_MODIFIED_BIT))
+                != (PTBL_VALID_BIT | PTBL_MODIFIED_BIT))
+            continue;
+        frame_number = (INT16) (*pte & PTBL_FRAME_BITS);
+        if (shadow_pg_tbl[frame_number] != pte || writing_back[frame_number])
+            continue;
+
+        *pte &= ~PTBL_MODIFIED_BIT;
+        writing_back[frame_number] = TRUE;
+        count_page_out(pid);
+        os_disk_write(map->disk_id, sector, (char *) &MEMORY[frame_number * PGSIZE]);
+        writing_back[frame_number] = FALSE;
+        wake_frame_waiters();
+        disk_map_writes++;
+    }
+}
+
+/**
+ * Write the modified pages of the current process which are mapped from a
+ * disk within a range back to their sectors.
+ * @param start_address: The virtual address of the range, page aligned.
+ * @param pages: The number of pages of the range.
+ * @param error: The error returned from the function.
+ */
+void os_sync_disk(long start_address, INT32 pages, long *error)
+{
+    INT32 start_vpn = (INT32) (start_address / PGSIZE);
+
+    assert(error);
+
+    *error = ERR_BAD_PARAM;
+    if (start_address < 0 || start_address % PGSIZE || pages <= 0
+            || start_vpn + pages > CurrentPCB->virtual_pages)
+        return;
+    sync_disk_range(CurrentPCB->pid, start_vpn, pages);
+    *error = ERR_SUCCESS;
+}
+
+/**
+ * Write every modified page a process has mapped from a disk back to its
+ * sector, called before the process terminates.
+ * @param pid: The process.
+ */
+void sync_disk_maps(INT32 pid)
+{
+    int i;
+
+    for (i = 0; i < disk_map_count[pid]; i++)
+        sync_disk_range(pid, disk_maps[pid][i].start_vpn, disk_maps[pid][i].pages);
+}
+
+/**
+ * Register a range of the address space of the current process for
+ * user-level fault handling. A fault on a missing page of the range is not
+ * served by the pager: it is sent to the handler process, which receives
+ * it with os_receive_fault() and fills the page with os_install_page(),
+ * while the faulting process is blocked. Once filled, the pages are paged
+ * like any other. The pages of the range must not have been touched yet. A
+ * fork does not pass the registration on, and it ends when the handler
+ * terminates.
+ * @param start_address: The virtual address of the range, page aligned.
+ * @param pages: The number of pages of the range.
+ * @param handler: The pid of the process handling the faults.
+ * @param error: The error returned from the function.
+ */
+void os_register_userfault(long start_address, INT32 pages, INT32 handler, long *error)
+{
+    INT32 pid = CurrentPCB->pid;
+    INT32 start_vpn = (INT32) (start_address / PGSIZE);
+    INT32 vpn;
+    INT32 page;
+    UINT32 *pte;
+    UserfaultRange *range;
+
+    assert(error);
+
+    *error = ERR_BAD_PARAM;
+    if (start_address < 0 || start_address % PGSIZE || pages <= 0
+            || start_vpn + pages > CurrentPCB->virtual_pages
+            || handler < 0 || handler >= MAX_NUMBER_OF_USER_PROCESSES
+            || handler == pid || !ProcessTable[handler]
+            || userfault_count[pid] == MAX_NUMBER_OF_USERFAULT_RANGES)
+        return;
+    for (vpn = start_vpn; vpn < start_vpn + pages; vpn++)
+    {
+        pte = lookup_pte(pid, vpn, FALSE);
+        if ((pte && *pte) || find_shared_area(pid, vpn, &page) || find_disk_map(pid, vpn, &page)
+                || find_userfault_handler(pid, vpn) >= 0)
+            return;
+    }
+
+    range = &userfault_ranges[pid][userfault_count[pid]++];
+    range->start_vpn = start_vpn;
+    range->pages = pages;
+    range->handler = handler;
+    *error = ERR_SUCCESS;
+}
+
+/**
+ * Receive the oldest fault sent to the current process as a fault handler,
+ * blocking until there is one.
+ * @param pid: Returns the pid of the faulting process.
+ * @param address: Returns the virtual address of the missing page.
+ * @param error: The error returned from the function, ERR_BAD_PARAM when
+ * no range is registered with the current process as its handler.
+ */
+void os_receive_fault(long *pid, long *address, long *error)
+{
+    INT32 me = CurrentPCB->pid;
+    INT32 other;
+    INT32 oldest;
+    int i;
+    int handling;
+
+    assert(pid && address && error);
+
+    for (;;)
+    {
+        oldest = -1;
+        handling = FALSE;
+        for (other = 0; other < MAX_NUMBER_OF_USER_PROCESSES; other++)
+        {
+            for (i = 0; i < userfault_count[other]; i++)
+                if (userfault_ranges[other][i].handler == me)
+                    handling = TRUE;
+            if (userfault_vpn[other] >= 0 && userfault_handler[other] == me
+                    && !userfault_delivered[other]
+                    && (oldest < 0 || userfault_raised_at[other] < userfault_raised_at[oldest]))
+                oldest = other;
+        }
+        if (oldest >= 0)
+        {
+            userfault_delivered[oldest] = TRUE;
+            *pid = oldest;
+            *address = (long) userfault_vpn[oldest] * PGSIZE;
+            *error = ERR_SUCCESS;
+            return;
+        }
+        if (!handling)
+        {
+            *error = ERR_BAD_PARAM;
+            return;
+        }
+        receiving_faults[me] = TRUE;
+        os_block_process();
+    }
+}
+
+/**
+ * Fill a missing page of a range the current process handles the faults
+ * of, and wake the process if it is blocked on the page. The page may be
+ * installed before it faults. The data is either copied from a buffer, or
+ * the page of the current process holding it is moved over without a copy;
+ * the moved page must be a private page in memory, and it is missing from
+ * the current process afterwards.
+ * @param pid: The process to install the page in.
+ * @param address: The virtual address of the page, page aligned.
+ * @param mode: USERFAULT_COPY or USERFAULT_MAP.
+ * @param source: The buffer to copy, or the virtual address of the page to
+ * move, page aligned.
+ * @param error: The error returned from the function.
+ */
+void os_install_page(INT32 pid, long address, INT32 mode, long source, long *error)
+{
+    INT32 me = CurrentPCB->pid;
+    INT32 vpn = (INT32) (address / PGSIZE);
+    INT32 source_vpn = (INT32) (source / PGSIZE);
+    INT32 page;
+    INT32 tlb_frame;
+    INT32 *entry;
+    INT16 frame_number;
+    UINT32 *pte;
+    UINT32 *source_pte;
+
+    assert(error);
+
+    *error = ERR_BAD_PARAM;
+    if (pid < 0 || pid >= MAX_NUMBER_OF_USER_PROCESSES || !ProcessTable[pid])
+    {
+        *error = ERR_PROCESS_DOESNT_EXIST;
+        return;
+    }
+    if (address < 0 || address % PGSIZE || find_userfault_handler(pid, vpn) != me)
+        return;
+    pte = lookup_pte(pid, vpn, TRUE);
+    if (!pte || *pte)
+        return;
+
+    if (mode == USERFAULT_COPY)
+    {
+        if (!source)
+            return;
+        frame_number = -1;
+        if (!at_frame_quota(pid))
+        {
+            frame_number = get_frame_number_of_removed_frame();
+            if (frame_number < 0)
+                frame_number = get_frame_number_of_zeroed_frame();
+        }
+        if (frame_number < 0)
+            frame_number = reclaim_frame(pid);
+        // The page was filled while a frame was written back for it.
+        if (*pte)
+        {
+            add_to_frame_queue(frame_number);
+            return;
+        }
+        memcpy(&MEMORY[frame_number * PGSIZE], (char *) source, PGSIZE);
+    }
+    else if (mode == USERFAULT_MAP)
+    {
+        if (source < 0 || source % PGSIZE || source_vpn >= CurrentPCB->virtual_pages)
+            return;
+        source_pte = lookup_pte(me, source_vpn, FALSE);
+        if (!source_pte || !(*source_pte & PTBL_VALID_BIT)
+                || (*source_pte & (PTBL_PROTECTED_BIT | PTBL_LARGE_PAGE_BIT))
+                || find_shared_area(me, source_vpn, &page) || find_disk_map(me, source_vpn, &page))
+            return;
+        frame_number = (INT16) (*source_pte & PTBL_FRAME_BITS);
+        if (shadow_pg_tbl[frame_number] != source_pte || writing_back[frame_number])
+            return;
+
+        tlb_frame = frame_number;
+        write_to_memory(Z502TLBInvalidate, &tlb_frame);
+        entry = lookup_swap_entry(me, source_vpn);
+        release_swap_slot(*entry);
+        *entry = NO_SWAP_SLOT;
+        *source_pte = 0;
+        swap_cache[frame_number] = FALSE;
+        detach_frame(frame_number);
+    }
+    else
+        return;
+
+    fresh_frame[frame_number] = FALSE;
+    *pte = (UINT32) (frame_number | PTBL_VALID_BIT);
+    attach_frame(frame_number, pid, vpn, pte);
+    userfault_pages_installed++;
+    if (userfault_vpn[pid] == vpn)
+    {
+        userfault_vpn[pid] = -1;
+        os_wake_process(pid);
+    }
+    *error = ERR_SUCCESS;
+}
+
+/**
+ * Copy the paging statistics of a process, or of the whole system.
+ * @param pid: The process, PAGING_STATS_SELF for the current one, or
+ * PAGING_STATS_SYSTEM for the whole system.
+ * @param stats: Returns the statistics.
+ * @param error: The error returned from the function.
+ */
+void os_get_paging_stats(INT32 pid, PAGING_STATS *stats, long *error)
+{
+    assert(stats && error);
+
+    if (pid == PAGING_STATS_SELF)
+        pid = CurrentPCB->pid;
+    if (pid == PAGING_STATS_SYSTEM)
+        *stats = system_paging_stats;
+    else if (pid >= 0 && pid < MAX_NUMBER_OF_USER_PROCESSES && ProcessTable[pid])
+    {
+        *stats = paging_stats[pid];
+        stats->free_frames_low_water = system_paging_stats.free_frames_low_water;
+    }
+    else
+    {
+        *error = ERR_PROCESS_DOESNT_EXIST;
+        return;
+    }
+    *error = ERR_SUCCESS;
+}
+
+/**
+ * Set a paging parameter of a process. PAGING_PARAMETER_FRAME_QUOTA sets
+ * the hard limit on the frames the process may hold, 0 for none; a quota
+ * must leave room for the minimum working set. A process above its new
+ * quota gives the extra frames back as it replaces its own pages.
+ * PAGING_PARAMETER_FAULT_AROUND sets the size of the block mapped around a
+ * fault, from 1, which turns fault-around off, up to a second level page
+ * table.
+ * @param pid: The process, -1 for the current one.
+ * @param parameter: The parameter to set.
+ * @param value: The new value.
+ * @param error: The error returned from the function.
+ */
+void os_set_paging_parameter(INT32 pid, INT32 parameter, INT32 value, long *error)
+{
+    PCB *pcb;
+
+    assert(error);
+
+    if (pid == -1)
+        pid = CurrentPCB->pid;
+    if (pid < 0 || pid >= MAX_NUMBER_OF_USER_PROCESSES || !ProcessTable[pid])
+    {
+        *error = ERR_PROCESS_DOESNT_EXIST;
+        return;
+    }
+    pcb = ProcessTable[pid];
+    switch (parameter)
+    {
+        case PAGING_PARAMETER_FRAME_QUOTA:
+            if (value < 0 || (value > 0 && value < WORKING_SET_MIN_FRAMES))
+            {
+                *error = ERR_BAD_PARAM;
+                return;
+            }
+            pcb->frame_quota = value;
+            frame_quota[pid] = value;
+            break;
+        case PAGING_PARAMETER_FAULT_AROUND:
+            if (value < 1 || value > PTBL_LEAF_ENTRIES)
+            {
+                *error = ERR_BAD_PARAM;
+                return;
+            }
+            pcb->fault_around = value;
+            break;
+        default:
+            *error = ERR_BAD_PARAM;
+            return;
+    }
+    *error = ERR_SUCCESS;
+}
+
+/**
+ * Print paging statistics, on one line for the counters and one for the
+ * fault latency histogram.
+ * @param name: What the statistics are of.
+ * @param stats: The statistics.
+ */
+static void print_paging_stats(const char *name, PAGING_STATS *stats)
+{
+    int bucket;
+
+    printf("Paging of %s: %d major faults, %d minor faults, %d evictions (%d clean, %d dirty), "
+           "%d page-ins, %d page-outs\n", name, stats->major_faults, stats->minor_faults,
+           stats->clean_evictions + stats->dirty_evictions, stats->clean_evictions,
+           stats->dirty_evictions, stats->page_ins, stats->page_outs);
+    printf("Fault latency of %s:", name);
+    for (bucket = 0; bucket < FAULT_LATENCY_BUCKETS - 1; bucket++)
+        printf(" <%d: %d", FAULT_LATENCY_BASE << bucket, stats->fault_latency[bucket]);
+    printf(" >=%d: %d\n", FAULT_LATENCY_BASE << (bucket - 1), stats->fault_latency[bucket]);
+}
+
+/**
+ * Add the TLB hits and misses the hardware counted for the running context
+ * since the last call to the counters of a process, and to the memory
+ * accesses of its priority. Must be called while the process is still the
+ * one running, before switching away from it.
+ * @param pid: The running process.
+ */
+void collect_tlb_stats(INT32 pid)
+{
+    INT32 count;
+
+    INT32 accesses;
+
+    read_from_memory(Z502TLBHits, &count);
+    tlb_hits[pid] += count;
+    accesses = count;
+    read_from_memory(Z502TLBMisses, &count);
+    tlb_misses[pid] += count;
+    accesses += count;
+    if (ProcessTable[pid])
+        priority_accesses[ProcessTable[pid]->priority] += accesses;
+}
+
+/**
+ * Print the paging statistics gathered since the OS started.
+ */
+void print_storage_stats(void)
+{
+    int pid;
+    int priority;
+    char name[16];
+
+    if (CurrentPCB)
+        collect_tlb_stats(CurrentPCB->pid);
+    printf("Read-ahead: %d pages read, %d hits (%d waited for the read), %d wasted\n",
+           read_ahead_issued, read_ahead_hits, read_ahead_waits, read_ahead_wasted);
+    printf("Fault-around: %d pages mapped\n", fault_around_mapped);
+    printf("Swap log: %d page-outs, mean seek %d sectors\n", swap_log_writes,
+           swap_log_writes ? swap_log_seek / swap_log_writes : 0);
+    printf("Zero pool: %d new pages served, %d zeroed on demand\n",
+           zero_pool_hits, zero_pool_misses);
+    printf("Load control: %d swap-outs evicting %d pages, %d swap-ins\n",
+           load_swap_outs, load_pages_evicted, load_swap_ins);
+    printf("Replacement: %d local, %d global\n", local_evictions, global_evictions);
+    printf("Inactive list: %d deactivated, %d refaults without I/O (mean distance %d)\n",
+           deactivations, inactive_refaults,
+           inactive_refaults ? inactive_refault_distance / inactive_refaults : 0);
+    printf("Refaults from disk: %d (mean distance %d), %d within %d deactivations\n",
+           disk_refaults, disk_refaults ? disk_refault_distance / disk_refaults : 0,
+           disk_refaults_near, ALL_MEM_PGS);
+    printf("Shared areas: %d pages mapped into a process\n", shared_pages_mapped);
+    printf("Copy-on-write: %d pages shared, %d copied, %d left to the last mapper\n",
+           cow_pages_shared, cow_copies, cow_unprotected);
+    printf("Same-page merging: %d frames scanned, %d merged\n", merge_scanned, merge_merged);
+    printf("Memory tiers: %d promotions, %d demotions\n", tier_promotions, tier_demotions);
+    printf("Large pages: %d mapped on a fault, %d collapsed, %d times no free run\n",
+           large_pages_mapped, large_pages_collapsed, large_page_fallbacks);
+    printf("Memory advice: %d calls, %d pages prefetched, %d dropped, %d dropped behind\n",
+           advice_calls, advice_prefetched, advice_dropped, advice_dropped_behind);
+    printf("Disk maps: %d pages read, %d written back\n", disk_map_reads, disk_map_writes);
+    printf("User faults: %d sent to a handler, %d pages installed\n",
+           userfaults_raised, userfault_pages_installed);
+    printf("Compressed cache: %d pages stored (%d same-filled) in %d%% of their size, %d hits, %d spilled\n",
+           compressed_stores, compressed_same_filled,
+           compressed_stores ? compressed_words * 4 * 100 / (compressed_stores * PGSIZE) : 0,
+           compressed_hits, compressed_spills);
+    printf("Priority replacement: %d unreferenced pages spared\n", priority_spared);
+    print_paging_stats("the system", &system_paging_stats);
+    printf("Free frames low-water mark: %d\n", system_paging_stats.free_frames_low_water);
+    printf("Frame waits: %d faults found every frame in flight\n", system_paging_stats.frame_waits);
+    for (priority = 0; priority <= MAX_PRIORITY; priority++)
+        if (priority_faults[priority] > 0)
+            printf("Faults at priority %d: %d in %d accesses, %d per 1000\n",
+                   priority, priority_faults[priority], priority_accesses[priority],
+                   priority_accesses[priority] ?
+                   (INT32) ((long) priority_faults[priority] * 1000 / priority_accesses[priority]) : 0);
+    for (pid = 0; pid < MAX_NUMBER_OF_USER_PROCESSES; pid++)
+    {
+        if (tlb_hits[pid] + tlb_misses[pid] > 0)
+            printf("TLB of pid %d: %d hits, %d misses\n", pid, tlb_hits[pid], tlb_misses[pid]);
+        if (page_dir_holder[pid])
+            printf("Working set of pid %d: %d resident, target %d, quota %d\n",
+                   pid, resident_pages[pid], frame_target[pid], frame_quota[pid]);
+        if (paging_stats[pid].major_faults + paging_stats[pid].minor_faults > 0)
+        {
+            sprintf(name, "pid %d", pid);
+            print_paging_stats(name, &paging_stats[pid]);
         }
     }
 }
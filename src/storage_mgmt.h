@@ -9,11 +9,102 @@
 #define	STORAGE_MGMT_H
 
 #include "base/global.h"
+#include "base/syscalls.h"
 
-#define PTBL_RESERVED_BIT  0x1000
-#define PTBL_STATE_BITS    0xE000
-#define PTBL_FRAME_BITS    0x0FFF
-#define NUM_OF_FRAMES      64
+#define PTBL_RESERVED_BIT  0x10000000
+#define PTBL_STATE_BITS    0xE0000000
+#define PTBL_STATE_SHIFT   29
+#define PTBL_FRAME_BITS    PTBL_PHYS_PG_NO
+#define PTBL_ALL_BITS      0xFFFFFFFF
+#define NUM_OF_FRAMES      PHYS_MEM_PGS
+
+// Swap space lives in the NUM_SWAP_SECTORS sectors every disk has after its
+// logical ones, which the user processes cannot reach. A swap slot number
+// encodes both the disk and the sector, consecutive slots are striped across
+// consecutive disks.
+#define SWAP_START_SECTOR        NUM_LOGICAL_SECTORS
+#define SWAP_SECTORS_PER_DISK    NUM_SWAP_SECTORS
+#define NUM_OF_SWAP_SLOTS        (MAX_NUMBER_OF_DISKS * SWAP_SECTORS_PER_DISK)
+#define NO_SWAP_SLOT             -1
+
+#define swap_slot_disk(slot)     ((INT32) ((slot) % MAX_NUMBER_OF_DISKS) + 1)
+#define swap_slot_sector(slot)   ((INT32) ((slot) / MAX_NUMBER_OF_DISKS) + SWAP_START_SECTOR)
+
+// The swap area of every disk is written as a log: page-outs are appended at
+// the write head of the disk, so consecutive writes hardly move the arm.
+// Bursts of up to SWAP_BURST_SLOTS page-outs go to the same disk.
+// The log is divided into segments, the cleaner moves a write head which runs
+// into live slots to the segment with the most dead slots.
+#define SWAP_BURST_SLOTS         32
+#define SWAP_SEGMENT_SLOTS       32
+#define SWAP_SEGMENTS_PER_DISK   (SWAP_SECTORS_PER_DISK / SWAP_SEGMENT_SLOTS)
+
+// When the faults of a process follow a constant stride, up to a window of the
+// following swapped-out pages is read ahead into the swap cache. The window
+// doubles on every read-ahead hit and halves on every page evicted unused.
+#define READ_AHEAD_MIN_WINDOW    1
+#define READ_AHEAD_MAX_WINDOW    8
+
+// Memory advice, see os_memory_advice(). A process reading a range marked
+// sequential has its pages SEQUENTIAL_DROP_DISTANCE pages behind the fault
+// dropped early: clean ones to the inactive list, dirty ones to the front
+// of the clock.
+#define SEQUENTIAL_DROP_DISTANCE 16
+
+// Load control. Page faults of all processes are counted over windows of
+// LOAD_CONTROL_WINDOW time units. Above the high water mark the system is
+// thrashing and the lowest priority ready process is swapped out as a whole;
+// below the low water mark a swapped process is let back in.
+#define LOAD_CONTROL_WINDOW      2000
+#define LOAD_CONTROL_HIGH_WATER  16
+#define LOAD_CONTROL_LOW_WATER   6
+
+// Working sets. Every process has a target number of frames, adjusted by its
+// page fault frequency: a fault within WORKING_SET_GROW_INTERVAL time units of
+// the previous one grows the target, a fault after more than
+// WORKING_SET_SHRINK_INTERVAL shrinks it. A process at its target (or at its
+// frame quota) replaces its own pages instead of those of its neighbours. The
+// targets of all processes add up to at most the physical memory.
+#define WORKING_SET_MIN_FRAMES      4
+#define WORKING_SET_INITIAL_FRAMES  16
+#define WORKING_SET_GROW_INTERVAL   500
+#define WORKING_SET_SHRINK_INTERVAL 2000
+
+// Priority-aware replacement, on with PRIORITY_REPLACEMENT. The clock passes
+// an unreferenced page by once more for every PRIORITY_WEIGHT_STEP levels its
+// owner is more important than the least important process holding frames,
+// up to PRIORITY_MAX_EXTRA_SWEEPS times. A process of priority
+// PRIORITY_PROTECTED_LEVEL or more important keeps PRIORITY_MIN_RESIDENT
+// frames, as long as other processes have frames left to give.
+#define PRIORITY_REPLACEMENT        TRUE
+#define PRIORITY_WEIGHT_STEP        10
+#define PRIORITY_MAX_EXTRA_SWEEPS   3
+#define PRIORITY_PROTECTED_LEVEL    4
+#define PRIORITY_MIN_RESIDENT       16
+
+// Once memory is full, up to INACTIVE_LIST_FRAMES frames are kept on the
+// inactive list: written back and unmapped, but still holding their page.
+#define INACTIVE_LIST_FRAMES     8
+
+// Same-page merging. Each time the OS is idle, MERGE_SCAN_FRAMES frames are
+// checksummed, and a frame whose checksum did not change since its last scan
+// is merged with an identical frame of another process at the same page.
+#define MERGE_SCAN_FRAMES        16
+
+// Compressed swap cache. The last COMPRESSED_CACHE_FRAMES frames are kept from
+// the processes and hold swapped-out pages in compressed form: only their
+// nonzero words are stored, and a page filled with one value takes no room at
+// all. When the cache is full, its oldest page is written to its swap slot.
+// 0 turns the cache off.
+#define COMPRESSED_CACHE_FRAMES  3
+#define COMPRESSED_CACHE_WORDS   (COMPRESSED_CACHE_FRAMES * PGSIZE / 4)
+#define PAGE_WORDS               (PGSIZE / 4)
+#define COMPRESSED_SAME_FILL     0x100
+
+// The least memory the OS runs in: the compressed cache, a full inactive list
+// and the minimum working set of a process, which covers an access straddling
+// two pages. Large pages fall back to single pages in a smaller memory.
+#define MIN_MEM_PGS (COMPRESSED_CACHE_FRAMES + INACTIVE_LIST_FRAMES + WORKING_SET_MIN_FRAMES)
 
 typedef struct disk
 {
@@ -32,8 +123,50 @@ typedef union
     UINT32 int_data[PGSIZE / sizeof (int)];
 } DISK_DATA;
 
+// A memory area shared by several processes under a tag. The entries of the
+// area hold the state of its pages, each process which touches a page gets
+// the frame copied into its own page table. start_vpn is indexed by pid,
+// -1 for processes which have not defined the area.
+typedef struct shared_area
+{
+    char tag[MAX_LENGTH_OF_AREA_TAG];
+    INT32 pages;
+    INT32 mappers;
+    INT32 start_vpn[MAX_NUMBER_OF_USER_PROCESSES];
+    UINT32 *pte;
+    INT32 *swap;
+} SharedArea;
+
+// A range of pages of a process with the access advice it was given.
+typedef struct advice_range
+{
+    INT32 start_vpn;
+    INT32 pages;
+    INT32 advice;
+} AdviceRange;
+
+// A range of sectors of a disk mapped into the address space of a process,
+// one sector per page, see os_map_disk().
+typedef struct disk_map
+{
+    INT32 start_vpn;
+    INT32 pages;
+    INT32 disk_id;
+    INT32 start_sector;
+} DiskMap;
+
+// A range of pages of a process whose missing pages are filled by a handler
+// process instead of the pager, see os_register_userfault().
+typedef struct userfault_range
+{
+    INT32 start_vpn;
+    INT32 pages;
+    INT32 handler;
+} UserfaultRange;
+
 /**
- * Initialize the frame queue and shallow page table.
+ * Initialize the frame queue and shallow page table. A memory smaller than
+ * MIN_MEM_PGS frames is refused.
  */
 void init_storage(void);
 
@@ -50,12 +183,91 @@ int add_to_frame_queue(INT16 frame_number);
  */
 INT16 get_frame_number_of_removed_frame(void);
 
+/**
+ * Get the number of a free frame which has already been zeroed.
+ * @return: The number of the frame, if the zero pool is empty, -1 is returned.
+ */
+INT16 get_frame_number_of_zeroed_frame(void);
+
+/**
+ * Zero the frames of the free frame queue and move them to the zero pool.
+ * Called when the OS is idle, so new pages find a clean frame ready.
+ */
+void refill_zero_pool(void);
+
 /**
  * Remove a frame form the frame queue.
  * @return: If the queue is empty, NULL is returned, or the pointer to the frame is returned.
  */
 Frame *removed_from_frame_queue(void);
 
+/**
+ * Allocate a free swap slot at the write head of a disk. A burst of up to
+ * SWAP_BURST_SLOTS allocations stays on one disk, so its page-outs are appended
+ * in one sequential run. A new burst starts on the least busy disk which still
+ * has free slots, ties are broken round robin, so that bursts are striped across all disks.
+ * @return: The number of the slot, if swap space is exhausted, NO_SWAP_SLOT is returned.
+ */
+INT32 allocate_swap_slot(void);
+
+// Memory tiers. Frames PHYS_MEM_PGS and up are the slow tier, new pages are
+// placed there first. Every scan of balance_memory_tiers() covers
+// TIER_SCAN_FRAMES frames, and a page whose heat reaches TIER_HOT_HEAT
+// (referenced at its last two scans) is promoted to the fast tier.
+#define TIER_SCAN_FRAMES         32
+#define TIER_HOT_HEAT            0xC0
+#define FRAME_HEAT_RECENT        0x80
+#define is_fast_frame(frame)     (SLOW_MEM_PGS > 0 && (frame) < PHYS_MEM_PGS)
+
+// Large pages of LARGE_PAGE_PGS pages, which is 1 << LARGE_PAGE_ORDER. The
+// buddy allocator keeps free runs of up to that size. A fault in a block of
+// untouched pages, right after the block before it was filled, maps the whole
+// block at once. Each time the OS is idle, the blocks of the pages held by
+// COLLAPSE_SCAN_FRAMES frames are collapsed into large pages if all their
+// pages are resident.
+#define LARGE_PAGE_ORDER         4
+#define COLLAPSE_SCAN_FRAMES     16
+
+/**
+ * Drop a reference to a swap slot, the last one returns it to the free pool.
+ * @param slot: The slot to release, NO_SWAP_SLOT is ignored.
+ */
+void release_swap_slot(INT32 slot);
+
+/**
+ * Merge identical pages, called when the OS is idle. A frame which kept its
+ * content since it was last scanned, and holds the same bytes as the frame
+ * of another process at the same virtual page, is freed. Its process maps
+ * the other frame copy-on-write instead.
+ */
+void merge_identical_frames(void);
+
+/**
+ * Balance the pages between the memory tiers, called after every fault and
+ * when the OS is idle. TIER_SCAN_FRAMES frames have the referenced bit of their
+ * page shifted into their heat. A page of the slow tier which turns hot is
+ * promoted to a free frame of the fast tier, or exchanged with the coldest
+ * page there, which is demoted.
+ */
+void balance_memory_tiers(void);
+
+/**
+ * Collapse blocks of pages into large pages, called when the OS is idle. For
+ * each of the next COLLAPSE_SCAN_FRAMES frames holding a page, the aligned
+ * block of LARGE_PAGE_PGS pages around its page is looked at. If every page of the block is resident
+ * and may be moved, the pages are moved into an aligned run of frames from the
+ * buddy allocator, unless they are in one already, and mapped as a large page.
+ */
+void collapse_large_pages(void);
+
+/**
+ * Clean the swap logs, called when the OS is idle. For every disk whose write
+ * head is in a segment that is mostly live, the head is moved to the start of
+ * the segment with the fewest live slots, the one closest to the arm on ties.
+ * Dead slots are reclaimed in place, no live page is copied.
+ */
+void clean_swap_log(void);
+
 /**
  * Write data into the specific position indicated by the disk id and sector id.
  * @param disk_id: Indicates which disk to write to. 
@@ -72,6 +284,144 @@ void os_disk_write(INT32 disk_id, INT32 sector, char *buffer);
  */
 void os_disk_read(INT32 disk_id, INT32 sector, char *buffer);
 
+/**
+ * Write a sector of a disk for the current process. Only the logical sectors
+ * can be written this way, the swap area is left to the pager.
+ * @param disk_id: Indicates which disk to write to.
+ * @param sector: Indicates which sector to write to.
+ * @param buffer: The data needs to be written.
+ * @param error: The error returned from the function.
+ */
+void os_user_disk_write(INT32 disk_id, INT32 sector, char *buffer, long *error);
+
+/**
+ * Read a sector of a disk for the current process. Only the logical sectors
+ * can be read this way, the swap area is left to the pager.
+ * @param disk_id: Indicates which disk to read from.
+ * @param sector: Indicates which sector to read from.
+ * @param buffer: The buffer to hold the data.
+ * @param error: The error returned from the function.
+ */
+void os_user_disk_read(INT32 disk_id, INT32 sector, char *buffer, long *error);
+
+/**
+ * Define a shared area in the address space of the current process. The
+ * first process to use a tag creates the area, the others map the same
+ * frames. The pages of the range must not have been touched yet.
+ * @param start_address: The virtual address of the area, page aligned.
+ * @param pages: The number of pages of the area.
+ * @param tag: The name of the area.
+ * @param shared_id: Returns how many processes defined the area before.
+ * @param error: The error returned from the function.
+ */
+void os_define_shared_area(long start_address, INT32 pages, const char *tag,
+                           long *shared_id, long *error);
+
+/**
+ * Give advice on how the current process is going to access a range of its
+ * pages. SEQUENTIAL and RANDOM are kept for the range and change how its
+ * faults are handled, NORMAL takes them back. WILLNEED starts reading the
+ * swapped-out pages of the range now, DONTNEED frees the pages of the range
+ * and their swap slots, so they read as zeros when touched again.
+ * @param start_address: The virtual address of the range, page aligned.
+ * @param pages: The number of pages of the range.
+ * @param advice: One of the ADVICE_ values.
+ * @param error: The error returned from the function.
+ */
+void os_memory_advice(long start_address, INT32 pages, INT32 advice, long *error);
+
+/**
+ * Map a range of sectors of a disk into the address space of the current
+ * process, one sector per page. The pages are read from their sectors when
+ * they are first touched, and written back to them when they are evicted
+ * dirty or synced, they never take a swap slot. The sectors must be logical
+ * ones, out of the swap area, and the pages of the range must not have been
+ * touched yet. A fork does not pass the mapping on. Disk reads and writes of
+ * the same sectors do not see the pages in memory, until they are synced.
+ * @param start_address: The virtual address of the range, page aligned.
+ * @param pages: The number of pages of the range.
+ * @param disk_id: The disk to map.
+ * @param start_sector: The sector mapped to the first page.
+ * @param error: The error returned from the function.
+ */
+void os_map_disk(long start_address, INT32 pages, INT32 disk_id, INT32 start_sector,
+                 long *error);
+
+/**
+ * Write the modified pages of the current process which are mapped from a
+ * disk within a range back to their sectors.
+ * @param start_address: The virtual address of the range, page aligned.
+ * @param pages: The number of pages of the range.
+ * @param error: The error returned from the function.
+ */
+void os_sync_disk(long start_address, INT32 pages, long *error);
+
+/**
+ * Write every modified page a process has mapped from a disk back to its
+ * sector, called before the process terminates.
+ * @param pid: The process.
+ */
+void sync_disk_maps(INT32 pid);
+
+/**
+ * Register a range of the current process for user-level fault handling.
+ * A fault on a page of the range which was never filled blocks the process
+ * and sends a fault message to the handler process, which fills the page
+ * with os_install_page(). Once filled, the page is paged like any other.
+ * The pages of the range must not have been touched yet. When the handler
+ * terminates, the pager fills the missing pages again.
+ * @param start_address: The virtual address of the range, page aligned.
+ * @param pages: The number of pages of the range.
+ * @param handler: The process which handles the faults, not the caller.
+ * @param error: The error returned from the function.
+ */
+void os_register_userfault(long start_address, INT32 pages, INT32 handler, long *error);
+
+/**
+ * Receive the next fault message for the current process as a handler,
+ * oldest first. Blocks until there is one.
+ * @param pid: Returns the process which faulted.
+ * @param address: Returns the address of the missing page.
+ * @param error: The error returned from the function, ERR_BAD_PARAM when
+ * no process has registered a range for the caller.
+ */
+void os_receive_fault(long *pid, long *address, long *error);
+
+/**
+ * Fill a missing page of a process which registered the current process as
+ * its handler, and wake the process if it is waiting for the page. The page
+ * may be filled before the process faults on it.
+ * @param pid: The process which owns the page.
+ * @param address: The virtual address of the page in that process.
+ * @param mode: USERFAULT_COPY copies PGSIZE bytes from a buffer,
+ * USERFAULT_MAP moves a resident page of the handler over, leaving the
+ * handler with an untouched page.
+ * @param source: The buffer to copy, or the virtual address of the page to
+ * move.
+ * @param error: The error returned from the function.
+ */
+void os_install_page(INT32 pid, long address, INT32 mode, long source, long *error);
+/**
+ * Copy the paging statistics of a process, or of the whole system.
+ * @param pid: The process, PAGING_STATS_SELF for the current one, or
+ * PAGING_STATS_SYSTEM for the whole system.
+ * @param stats: Returns the statistics.
+ * @param error: The error returned from the function.
+ */
+void os_get_paging_stats(INT32 pid, PAGING_STATS *stats, long *error);
+/**
+ * Set a paging parameter of a process. PAGING_PARAMETER_FRAME_QUOTA sets
+ * the hard limit on the frames the process may hold, 0 for none; a quota
+ * must leave room for the minimum working set. PAGING_PARAMETER_FAULT_AROUND
+ * sets the size of the block mapped around a fault, from 1, which turns
+ * fault-around off, up to a second level page table.
+ * @param pid: The process, -1 for the current one.
+ * @param parameter: The parameter to set.
+ * @param value: The new value.
+ * @param error: The error returned from the function.
+ */
+void os_set_paging_parameter(INT32 pid, INT32 parameter, INT32 value, long *error);
+
 /**
  * Used for interrupt handler. According to the action the process wants to take,
  * do the corresponding work and call dispatcher to schedule the processes.
@@ -80,7 +430,61 @@ void os_disk_read(INT32 disk_id, INT32 sector, char *buffer);
 void read_write_scheduler(INT32 device_id);
 
 /**
- * Used in fault handler. Deal with the page fault and map the pages to the frames.
+ * Give a child process a copy-on-write clone of the address space of its
+ * parent. Resident pages are mapped into the child at the same frames, and
+ * both are protected, so the first write of either gets a copy. Swapped
+ * pages share the swap slot. The child joins the shared areas of the parent
+ * at the same addresses, and inherits its memory advice. Disk maps are not
+ * passed on, their range is left untouched in the child.
+ * @param parent: The pid of the forking process.
+ * @param child: The pid of the new process, which has not run yet.
+ */
+void clone_address_space(INT32 parent, INT32 child);
+
+/**
+ * Wait until no read ahead is filling a frame of a process, so its frames
+ * can be freed. Called before its address space is torn down.
+ * @param pid: The process.
+ */
+void finish_read_ahead(INT32 pid);
+
+/**
+ * Clear the paging state and statistics a pid kept from the process which
+ * had it before, so a new process starts with none of them.
+ * @param pid: The pid of the new process.
+ */
+void reset_paging_state(INT32 pid);
+
+/**
+ * Tear down the address space of a terminated process. It leaves its shared
+ * areas, its frames go back to the frame queue, its swap slots to the free
+ * pool, and its page tables are freed. A frame it shares copy-on-write goes
+ * to another of its mappers. While a frame of the process is being written
+ * back, only its other private frames are freed: the writer still updates
+ * the page table entry and the swap slot of the page, and the call has to be
+ * repeated once the write is done.
+ * @param pid: The terminated process.
+ * @return: TRUE if the address space is gone, FALSE if a write back holds it.
+ */
+BOOL release_address_space(INT32 pid);
+
+/**
+ * Add the TLB hits and misses the hardware counted for the running context
+ * since the last call to the counters of a process, and to the memory
+ * accesses of its priority. Must be called while the process is still the
+ * one running, before switching away from it.
+ * @param pid: The running process.
+ */
+void collect_tlb_stats(INT32 pid);
+
+/**
+ * Print the paging statistics gathered since the OS started.
+ */
+void print_storage_stats(void);
+
+/**
+ * Used in fault handler. Deal with the page fault and map the pages to the
+ * frames, and count the fault in the paging statistics.
  * @param status: The virtual page number obtained from fault handler.
  */
 void frame_scheduler(INT32 status);